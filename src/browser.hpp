@@ -0,0 +1,385 @@
+#ifndef __BROWSER_HPP_INCLUDED__
+#define __BROWSER_HPP_INCLUDED__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include <string.h> // strcmp(), strstr()
+
+#include "fs.hpp"
+#include "node_tree.hpp"
+#include "console.hpp"
+
+namespace browser {
+    enum class sort_key {
+        size,
+        name,
+        modify_time
+    };
+
+    /*
+        Replaces the children of the node by the children of the source node,
+        copied from another tree. Nodes are copied breadth first, the children
+        of each node are appended in one go and stay a contiguous range.
+    */
+    void graft(fs::node_tree &tree, const fs::node_id node, const fs::node_tree &source, const fs::node_id source_node) {
+        fs::node_arena &arena = tree.local_arena();
+        std::deque<std::pair<fs::node_id, fs::node_id>> queue { {source_node, node} };
+        while (!queue.empty()) {
+            const auto [from, to] = queue.front();
+            queue.pop_front();
+            const fs::node_arena &source_arena { source.arena(from) };
+            fs::node_id first {fs::no_node};
+            const unsigned int child_count { source_arena.child_count(from) };
+            for (unsigned int i = 0; i < child_count; i++) {
+                const fs::node_id child { source_arena.first_child(from) + i };
+                const fs::node_arena &child_arena { source.arena(child) };
+                const fs::node_id copy { arena.append(to, child_arena.name(child), child_arena.type(child)) };
+                fs::file_stat_t stat {};
+                stat.error = child_arena.error(child);
+                stat.type = child_arena.type(child);
+                stat.length = child_arena.length(child);
+                stat.access_time = child_arena.access_time(child);
+                stat.modify_time = child_arena.modify_time(child);
+                stat.change_time = child_arena.change_time(child);
+                arena.set_stat(copy, stat);
+                if (first == fs::no_node)
+                    first = copy;
+                queue.emplace_back(child, copy);
+            }
+            tree.arena(to).set_children(to, first, child_count);
+        }
+    }
+
+    /*
+        Full screen browser over a scanned tree. Directories are entered and
+        left, re-sorted and filtered within the tree, the file system is only
+        read again to rescan the shown directory on request. Only the visible
+        rows are drawn, the screen sends the changed cells to the terminal.
+    */
+    class tree_browser {
+        private:
+            struct level_t {
+                fs::node_id node;
+                std::size_t selected;
+                std::size_t top; // first visible entry
+            };
+
+            // Rescan of a directory into a tree of its own, grafted once done
+            struct rescan_t {
+                fs::node_id node;
+                fs::node_tree tree {};
+                fs::node_id root {fs::no_node};
+                fs::file_error error {fs::file_error::none};
+                unsigned long length {0};
+                std::atomic_bool cancelled {false};
+                std::future<void> done {};
+            };
+
+            fs::node_tree &tree;
+            console::tty &terminal;
+            const unsigned int fields;
+            const fs::mount_policy *policy;
+            const std::function<std::string (unsigned long)> format_length;
+
+            std::vector<level_t> path {};
+            std::vector<fs::node_id> listing {}; // entries of the shown directory, filtered and sorted
+            browser::sort_key order {browser::sort_key::size};
+            bool inverted {false};
+            std::string filter {""};
+            bool filter_input {false};
+            std::string message {""};
+            std::unique_ptr<rescan_t> rescan {nullptr};
+
+            const char *name(const fs::node_id node) const { return tree.arena(node).name(node); }
+            unsigned long length(const fs::node_id node) const { return tree.arena(node).length(node); }
+
+            void update_listing() {
+                const fs::node_id node { path.back().node };
+                listing.clear();
+                for (const fs::node_id child: tree.children(node)) {
+                    if (filter.empty() || strstr(name(child), filter.c_str()) != nullptr)
+                        listing.push_back(child);
+                }
+
+                const auto compare = [this] (const fs::node_id first, const fs::node_id second) {
+                    switch (order) {
+                        case browser::sort_key::name:
+                            return strcmp(name(first), name(second)) < 0;
+                        case browser::sort_key::modify_time:
+                            return tree.arena(first).modify_time(first) > tree.arena(second).modify_time(second);
+                        default:
+                            return length(first) > length(second);
+                    }
+                };
+                if (inverted)
+                    std::sort(listing.begin(), listing.end(), [&compare] (const fs::node_id first, const fs::node_id second) { return compare(second, first); });
+                else
+                    std::sort(listing.begin(), listing.end(), compare);
+
+                level_t &level = path.back();
+                if (level.selected >= listing.size())
+                    level.selected = listing.empty() ? 0 : listing.size() - 1;
+            }
+
+            void select(const long offset) {
+                level_t &level = path.back();
+                if (listing.empty())
+                    return;
+                const long selected { static_cast<long>(level.selected) + offset };
+                level.selected = std::clamp(selected, 0l, static_cast<long>(listing.size()) - 1);
+            }
+
+            void enter() {
+                if (listing.empty())
+                    return;
+                const fs::node_id node { listing[path.back().selected] };
+                if (tree.arena(node).type(node) != fs::file_type::directory)
+                    return;
+                path.push_back(level_t{node, 0, 0});
+                filter.clear();
+                update_listing();
+            }
+
+            void leave() {
+                if (path.size() < 2)
+                    return;
+                const fs::node_id node { path.back().node };
+                path.pop_back();
+                filter.clear();
+                update_listing();
+                const auto found = std::find(listing.begin(), listing.end(), node);
+                if (found != listing.end())
+                    path.back().selected = found - listing.begin();
+            }
+
+            void start_rescan() {
+                if (rescan != nullptr)
+                    return;
+                rescan = std::make_unique<rescan_t>();
+                rescan->node = path.back().node;
+                rescan->root = rescan->tree.local_arena().append(fs::no_node, tree.path(rescan->node), fs::file_type::directory);
+                rescan->done = std::async(std::launch::async, [this, job = rescan.get()] {
+                    std::shared_ptr<fs::directory> dir = fs::open_directory(job->tree.arena(job->root).name(job->root));
+                    if (dir == nullptr) {
+                        job->error = fs::to_file_error(errno);
+                        return;
+                    }
+                    job->length = fs::read_file(job->tree.arena(job->root).name(job->root), fields).length;
+                    job->length += fs::scan_subtree(job->tree, job->root, *dir, fields, policy, &job->cancelled, job->error, [] (const fs::directory &, const fs::node_id) {});
+                });
+            }
+
+            // Replaces the rescanned directory's contents once the rescan is done, returns true if replaced
+            bool finish_rescan() {
+                if (rescan == nullptr || rescan->done.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                    return false;
+                const fs::node_id node { rescan->node };
+                if (rescan->error != fs::file_error::none && rescan->tree.arena(rescan->root).child_count(rescan->root) == 0) {
+                    message = "Rescan failed: " + tree.path(node);
+                    rescan = nullptr;
+                    return true;
+                }
+
+                graft(tree, node, rescan->tree, rescan->root);
+                const long delta { static_cast<long>(rescan->length) - static_cast<long>(length(node)) };
+                for (fs::node_id ancestor = node; ancestor != fs::no_node; ancestor = tree.arena(ancestor).parent(ancestor))
+                    tree.arena(ancestor).length(ancestor) += delta;
+                tree.arena(node).error(node) = rescan->error;
+                message = "Rescanned: " + tree.path(node);
+                rescan = nullptr;
+
+                // The former contents of the directory are left, so are the levels entered below it
+                for (std::size_t i = 0; i < path.size(); i++) {
+                    if (path[i].node == node) {
+                        path.resize(i + 1);
+                        break;
+                    }
+                }
+                update_listing();
+                return true;
+            }
+
+            void draw() {
+                const int cols { terminal.cols };
+                const int rows { terminal.rows };
+                terminal.clear();
+                if (rows < 3 || cols < 20) {
+                    terminal.redraw();
+                    return;
+                }
+                const fs::node_id node { path.back().node };
+                const unsigned long total { length(node) };
+
+                // Header: directory and its size
+                std::string header { " " + tree.path(node) + "  " + format_length(total) + "  (" + std::to_string(listing.size()) + (filter.empty() ? "" : " matching") + " entries)" };
+                header.resize(std::max(static_cast<std::size_t>(cols), header.length()), ' ');
+                terminal.write(0, 0, header, console::style::inverse);
+
+                // Entries, the selected one kept visible
+                level_t &level = path.back();
+                const std::size_t visible { static_cast<std::size_t>(rows - 2) };
+                if (level.selected < level.top)
+                    level.top = level.selected;
+                else if (level.selected >= level.top + visible)
+                    level.top = level.selected - visible + 1;
+
+                std::size_t size_width {0};
+                std::vector<std::string> sizes {};
+                for (std::size_t i = level.top; i < std::min(listing.size(), level.top + visible); i++) {
+                    sizes.push_back(format_length(length(listing[i])));
+                    size_width = std::max(size_width, sizes.back().length());
+                }
+                const int name_width { std::min(35, cols / 3) };
+                const int bar_width { std::max(cols - 1 - name_width - 1 - static_cast<int>(size_width) - 1 - 2 - 5, 0) };
+                for (std::size_t i = level.top; i < std::min(listing.size(), level.top + visible); i++) {
+                    const fs::node_id child { listing[i] };
+                    const fs::node_arena &arena { tree.arena(child) };
+                    const int y { static_cast<int>(i - level.top) + 1 };
+                    const bool selected { i == level.selected };
+                    const console::style row_style { selected ? console::style::inverse : console::style::normal };
+
+                    if (arena.error(child) == fs::file_error::incomplete)
+                        terminal.write(0, y, ">", selected ? row_style : console::style::yellow);
+                    else if (arena.error(child) != fs::file_error::none)
+                        terminal.write(0, y, "!", selected ? row_style : console::style::red);
+                    else
+                        terminal.write(0, y, arena.type(child) == fs::file_type::directory ? "*" : " ", row_style);
+
+                    std::string entry_name { arena.name(child) };
+                    if (arena.type(child) == fs::file_type::directory)
+                        entry_name += '/';
+                    const int name_length { static_cast<int>(console::text_width(entry_name)) };
+                    if (name_length > name_width)
+                        entry_name = entry_name.substr(0, name_width - 2) + "..";
+                    else
+                        entry_name += std::string(name_width - name_length, ' ');
+                    const std::string &size_text { sizes[i - level.top] };
+                    const std::string row { entry_name + " " + std::string(size_width - size_text.length(), ' ') + size_text + " " };
+                    int x { 1 + terminal.write(1, y, row, row_style) };
+
+                    const double factor { total > 0 ? static_cast<double>(length(child)) / static_cast<double>(total) : 0.0 };
+                    const int filled { static_cast<int>(bar_width * std::min(factor, 1.0)) };
+                    const int percent { static_cast<int>(factor * 100.0) };
+                    x += terminal.write(x, y, "[", row_style);
+                    x += terminal.write(x, y, std::string(filled, '='), selected ? row_style : percent >= 50 ? console::style::red : percent >= 25 ? console::style::yellow : console::style::green);
+                    x += terminal.write(x, y, std::string(bar_width - filled, ' ') + "]", row_style);
+                    const std::string percent_text { std::to_string(percent) + "%" };
+                    terminal.write(x, y, std::string(5 - std::min<std::size_t>(percent_text.length(), 5), ' ') + percent_text, row_style);
+                }
+
+                // Footer: filter being typed, last message or key help
+                std::string footer {""};
+                if (filter_input)
+                    footer = " Filter: " + filter + "_";
+                else if (message.length() > 0)
+                    footer = " " + message;
+                else
+                    footer = " q:quit  enter/left:open/back  s:sort (" + std::string(order == browser::sort_key::size ? "size" : order == browser::sort_key::name ? "name" : "mtime") + ")  i:invert  /:filter  r:rescan";
+                if (rescan != nullptr)
+                    footer += "  [rescanning...]";
+                footer.resize(std::max(static_cast<std::size_t>(cols), footer.length()), ' ');
+                terminal.write(0, rows - 1, footer, console::style::inverse);
+                terminal.redraw();
+            }
+
+        public:
+            tree_browser() = delete;
+            tree_browser(const tree_browser &) = delete;
+            tree_browser &operator=(const tree_browser &) = delete;
+
+            tree_browser(fs::node_tree &tree_, const fs::node_id root, console::tty &terminal_, const unsigned int fields_, const fs::mount_policy *policy_, const std::function<std::string (unsigned long)> &format_length_) : tree(tree_), terminal(terminal_), fields(fields_), policy(policy_), format_length(format_length_) {
+                path.push_back(level_t{root, 0, 0});
+            }
+
+            ~tree_browser() {
+                if (rescan != nullptr) {
+                    rescan->cancelled.store(true);
+                    rescan->done.wait();
+                }
+            }
+
+            void set_order(const browser::sort_key key, const bool invert) {
+                order = key;
+                inverted = invert;
+            }
+
+            // Handles key presses until quit
+            void run() {
+                update_listing();
+                while (true) {
+                    terminal.update_size();
+                    finish_rescan();
+                    draw();
+
+                    const console::key_event_t event { terminal.read_key(rescan != nullptr ? 100 : -1) };
+                    if (event.key == console::key::none)
+                        continue;
+                    if (event.key == console::key::character && event.c == '\x03') // Ctrl-C
+                        return;
+                    message.clear();
+
+                    if (filter_input) {
+                        if (event.key == console::key::character && static_cast<unsigned char>(event.c) >= 32)
+                            filter += event.c;
+                        else if (event.key == console::key::backspace && !filter.empty())
+                            filter.pop_back();
+                        else if (event.key == console::key::escape)
+                            filter.clear();
+                        if (event.key == console::key::enter || event.key == console::key::escape)
+                            filter_input = false;
+                        update_listing();
+                        continue;
+                    }
+
+                    const long page { std::max(terminal.rows - 2, 1) };
+                    const char c { event.key == console::key::character ? event.c : '\0' };
+                    if (c == 'q')
+                        return;
+                    else if (event.key == console::key::up || c == 'k')
+                        select(-1);
+                    else if (event.key == console::key::down || c == 'j')
+                        select(1);
+                    else if (event.key == console::key::page_up)
+                        select(-page);
+                    else if (event.key == console::key::page_down)
+                        select(page);
+                    else if (event.key == console::key::home || c == 'g')
+                        select(-static_cast<long>(listing.size()));
+                    else if (event.key == console::key::end || c == 'G')
+                        select(listing.size());
+                    else if (event.key == console::key::right || event.key == console::key::enter || c == 'l')
+                        enter();
+                    else if (event.key == console::key::left || event.key == console::key::backspace || c == 'h')
+                        leave();
+                    else if (c == 's') {
+                        order = order == browser::sort_key::size ? browser::sort_key::name : (order == browser::sort_key::name && (fields & fs::file_field::field_modify_time)) ? browser::sort_key::modify_time : browser::sort_key::size;
+                        update_listing();
+                    }
+                    else if (c == 'i') {
+                        inverted = !inverted;
+                        update_listing();
+                    }
+                    else if (c == '/') {
+                        filter_input = true;
+                    }
+                    else if (event.key == console::key::escape && !filter.empty()) {
+                        filter.clear();
+                        update_listing();
+                    }
+                    else if (c == 'r') {
+                        start_rescan();
+                    }
+                }
+            }
+    };
+}
+
+#endif //__BROWSER_HPP_INCLUDED__
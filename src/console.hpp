@@ -7,7 +7,16 @@
 #include <iostream>
 #include <vector>
 
+#include <algorithm>
+
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h> // open()
+#include <poll.h>
+#include <signal.h> // sigaction()
+#include <termios.h>
+#include <unistd.h> // read(), write()
+#include <sys/ioctl.h> // TIOCGWINSZ
 
 // Reference: https://en.wikipedia.org/wiki/ANSI_escape_code#Colors
 #define ANSI_COLOR_FOREGROUND_RESET            "\x1b[0;0m"
@@ -38,6 +47,9 @@
 #define ANSI_COLOR_BACKGROUND_MAGENTA          "\x1b[1;45m"
 #define ANSI_COLOR_BACKGROUND_CYAN             "\x1b[1;46m"
 #define ANSI_COLOR_BACKGROUND_WHITE            "\x1b[1;47m"
+// Cursor
+#define ANSI_CURSOR_NEXT_LINE                  "\x1b[1E"
+#define ANSI_ERASE_LINE                        "\x1b[2K"
 
 // TODO: move into console namespace
 struct exec_result_t {
@@ -311,22 +323,255 @@ namespace console {
         return args;
     }
 
+    /*
+        Replaces rows previously written to the stream, the cursor being
+        below the last of them. Only the rows which differ are rewritten.
+    */
+    void update_rows(std::ostream &stream, const std::vector<std::string> &previous, const std::vector<std::string> &current) {
+        if (previous.size() > 0)
+            stream << "\x1b[" << previous.size() << "F";
+        for (std::size_t i = 0; i < current.size(); i++) {
+            if (i < previous.size() && previous[i] == current[i])
+                stream << ANSI_CURSOR_NEXT_LINE;
+            else
+                stream << ANSI_ERASE_LINE << current[i] << '\n';
+        }
+        for (std::size_t i = current.size(); i < previous.size(); i++)
+            stream << ANSI_ERASE_LINE << '\n';
+        if (previous.size() > current.size())
+            stream << "\x1b[" << previous.size() - current.size() << "F";
+        stream << std::flush;
+    }
+
+    enum class style {
+        normal,
+        inverse,
+        red,
+        yellow,
+        green
+    };
+
+    /*
+        Double buffered screen contents. Cells are written to the back buffer,
+        render() returns the escape sequences turning the front buffer (what
+        the terminal shows) into the back buffer, changed cells only.
+    */
+    class screen {
+        private:
+            struct cell_t {
+                std::string glyph; // a single UTF-8 character
+                console::style style;
+
+                bool operator==(const cell_t &other) const { return style == other.style && glyph == other.glyph; }
+            };
+
+            int width {0};
+            int height {0};
+            std::vector<cell_t> front {};
+            std::vector<cell_t> back {};
+            bool invalid {true}; // terminal contents unknown, redrawn completely
+
+            static const char *get_style(const console::style cell_style) {
+                switch (cell_style) {
+                    case console::style::inverse:
+                        return "\x1b[0;7m";
+                    case console::style::red:
+                        return console::color::enable ? ANSI_COLOR_FOREGROUND_BRIGHT_RED : ANSI_COLOR_FOREGROUND_RESET;
+                    case console::style::yellow:
+                        return console::color::enable ? ANSI_COLOR_FOREGROUND_BRIGHT_YELLOW : ANSI_COLOR_FOREGROUND_RESET;
+                    case console::style::green:
+                        return console::color::enable ? ANSI_COLOR_FOREGROUND_BRIGHT_GREEN : ANSI_COLOR_FOREGROUND_RESET;
+                    default:
+                        return ANSI_COLOR_FOREGROUND_RESET;
+                }
+            }
+
+        public:
+            screen(const int cols, const int rows) {
+                resize(cols, rows);
+            }
+
+            int cols() const { return width; }
+            int rows() const { return height; }
+
+            void resize(const int cols, const int rows) {
+                width = std::max(cols, 0);
+                height = std::max(rows, 0);
+                front.assign(width * height, cell_t{" ", console::style::normal});
+                back = front;
+                invalid = true;
+            }
+
+            // Forces a complete redraw, e.g. after the terminal was written to by others
+            void invalidate() {
+                invalid = true;
+            }
+
+            void clear() {
+                std::fill(back.begin(), back.end(), cell_t{" ", console::style::normal});
+            }
+
+            void set(const int x, const int y, const std::string &glyph, const console::style cell_style) {
+                if (x < 0 || x >= width)
+                    throw std::out_of_range("X coordinate (" + std::to_string(x) + ") is out of range (0-" + std::to_string(width) + ").");
+                if (y < 0 || y >= height)
+                    throw std::out_of_range("Y coordinate (" + std::to_string(y) + ") is out of range (0-" + std::to_string(height) + ").");
+                back[y * width + x] = cell_t{glyph, cell_style};
+            }
+
+            // Writes the text from the given cell on, clipped at the end of the row, returns the number of cells written
+            int write(const int x, const int y, const std::string &text, const console::style cell_style) {
+                int column {x};
+                for (std::size_t i = 0; i < text.length() && column < width; column++) {
+                    const unsigned char c = text[i];
+                    std::size_t length {1};
+                    if ((c & 0xE0) == 0xC0)
+                        length = 2;
+                    else if ((c & 0xF0) == 0xE0)
+                        length = 3;
+                    else if ((c & 0xF8) == 0xF0)
+                        length = 4;
+                    if (c < 32 || c == 127 || (c > 127 && length == 1) || i + length > text.length())
+                        set(column, y, "?", cell_style); // Control character or broken UTF-8
+                    else
+                        set(column, y, text.substr(i, length), cell_style);
+                    i += length;
+                }
+                return column - x;
+            }
+
+            std::string render() {
+                std::string output {""};
+                if (invalid)
+                    output += ANSI_COLOR_FOREGROUND_RESET "\x1b[2J";
+                int cursor_x {-1};
+                int cursor_y {-1};
+                const console::style unknown_style { static_cast<console::style>(-1) };
+                console::style current_style { invalid ? console::style::normal : unknown_style };
+                for (int y = 0; y < height; y++) {
+                    for (int x = 0; x < width; x++) {
+                        const cell_t &cell = back[y * width + x];
+                        if (!invalid && cell == front[y * width + x])
+                            continue;
+                        if (cursor_x != x || cursor_y != y)
+                            output += "\x1b[" + std::to_string(y + 1) + ";" + std::to_string(x + 1) + "H";
+                        if (cell.style != current_style) {
+                            output += get_style(cell.style);
+                            current_style = cell.style;
+                        }
+                        output += cell.glyph;
+                        cursor_x = x + 1;
+                        cursor_y = y;
+                    }
+                }
+                if (current_style != console::style::normal && current_style != unknown_style)
+                    output += ANSI_COLOR_FOREGROUND_RESET;
+                front = back;
+                invalid = false;
+                return output;
+            }
+    };
+
+    enum class key {
+        none,
+        character,
+        up,
+        down,
+        left,
+        right,
+        page_up,
+        page_down,
+        home,
+        end,
+        enter,
+        backspace,
+        escape
+    };
+
+    struct key_event_t {
+        console::key key;
+        char c; // if key is console::key::character
+    };
+
+    // Decodes the next key press of the terminal input, the offset is advanced past it
+    console::key_event_t parse_key(const std::string &input, std::size_t &offset) {
+        if (offset >= input.length())
+            return console::key_event_t{console::key::none, '\0'};
+        const char c { input[offset++] };
+        if (c == '\r' || c == '\n')
+            return console::key_event_t{console::key::enter, c};
+        if (c == 127 || c == '\b')
+            return console::key_event_t{console::key::backspace, c};
+        if (c != '\x1b')
+            return console::key_event_t{console::key::character, c};
+        if (offset + 1 >= input.length() || (input[offset] != '[' && input[offset] != 'O'))
+            return console::key_event_t{console::key::escape, c};
+
+        // CSI/SS3 sequence: "\x1b[" parameters final character, e.g. "\x1b[A", "\x1b[5~"
+        std::size_t end { offset + 1 };
+        while (end < input.length() && input[end] >= '0' && input[end] <= '9')
+            end++;
+        if (end >= input.length())
+            return console::key_event_t{console::key::escape, c};
+        const std::string parameter { input.substr(offset + 1, end - offset - 1) };
+        const char final_char { input[end] };
+        offset = end + 1;
+        switch (final_char) {
+            case 'A': return console::key_event_t{console::key::up, '\0'};
+            case 'B': return console::key_event_t{console::key::down, '\0'};
+            case 'C': return console::key_event_t{console::key::right, '\0'};
+            case 'D': return console::key_event_t{console::key::left, '\0'};
+            case 'H': return console::key_event_t{console::key::home, '\0'};
+            case 'F': return console::key_event_t{console::key::end, '\0'};
+            case '~':
+                if (parameter == "1" || parameter == "7")
+                    return console::key_event_t{console::key::home, '\0'};
+                if (parameter == "4" || parameter == "8")
+                    return console::key_event_t{console::key::end, '\0'};
+                if (parameter == "5")
+                    return console::key_event_t{console::key::page_up, '\0'};
+                if (parameter == "6")
+                    return console::key_event_t{console::key::page_down, '\0'};
+                [[fallthrough]];
+            default:
+                return console::key_event_t{console::key::none, '\0'}; // Unsupported sequence, skipped
+        }
+    }
+
     class tty {
         private:
+            int fd {-1};
+            struct termios saved_mode {};
+            struct sigaction saved_resize_action {};
+            inline static int resize_pipe[2] {-1, -1};
+            console::screen buffer {0, 0};
+            std::string input {""};
+            std::size_t input_offset {0};
+
             void write_char(int x, int y, char c, bool sync) {
-                if (x < 0 || x >= cols)
-                    throw std::out_of_range("X coordinate (" + std::to_string(x) + ") is out of range (0-" + std::to_string(cols) + ").");
-                if (y < 0 || y >= rows)
-                    throw std::out_of_range("Y coordinate (" + std::to_string(y) + ") is out of range (0-" + std::to_string(rows) + ").");
-
-                // TODO: implement
-                (void)c;
-                (void)sync;
-                throw std::runtime_error("write_char() is not yet implemented.");
-
-                //if (sync)
-                //    redraw();
+                buffer.set(x, y, std::string(1, c), console::style::normal);
+                if (sync)
+                    redraw();
+            }
+
+            void write_output(const std::string &output) {
+                for (std::size_t written = 0; written < output.length();) {
+                    const ssize_t result { ::write(fd, output.data() + written, output.length() - written) };
+                    if (result == -1 && errno == EINTR)
+                        continue;
+                    if (result == -1)
+                        throw std::runtime_error("Failed to write to terminal");
+                    written += result;
+                }
             }
+
+            // note: may run on any thread, only wakes up read_key()
+            static void on_resize(int) {
+                const int saved_errno { errno };
+                [[maybe_unused]] const ssize_t result { ::write(resize_pipe[1], "", 1) };
+                errno = saved_errno;
+            }
+
         public:
             int cols {0};
             int rows {0};
@@ -345,16 +590,99 @@ namespace console {
             }
 
             ~tty() {
+                stop();
+            }
+
+            /*
+                Switches the terminal to the alternate screen, keys are read
+                unbuffered and without echo. The terminal generates no signals,
+                Ctrl-C is read as the character '\x03' instead, so the screen is
+                always restored by stop(). A resize (SIGWINCH) wakes up a
+                waiting read_key().
+            */
+            void start() {
+                if (fd != -1)
+                    return;
+                fd = open("/dev/tty", O_RDWR | O_CLOEXEC);
+                if (fd == -1)
+                    throw std::runtime_error("Failed to open terminal: /dev/tty");
+                tcgetattr(fd, &saved_mode);
+                struct termios mode { saved_mode };
+                mode.c_lflag &= ~(ICANON | ECHO | ISIG);
+                mode.c_cc[VMIN] = 1;
+                mode.c_cc[VTIME] = 0;
+                tcsetattr(fd, TCSAFLUSH, &mode);
+                if (resize_pipe[0] == -1 && pipe2(resize_pipe, O_NONBLOCK | O_CLOEXEC) == -1)
+                    throw std::runtime_error("Failed to create pipe");
+                struct sigaction action {};
+                action.sa_handler = on_resize;
+                sigemptyset(&action.sa_mask);
+                action.sa_flags = SA_RESTART;
+                sigaction(SIGWINCH, &action, &saved_resize_action);
+                write_output("\x1b[?1049h\x1b[?25l");
+                update_size();
+                buffer.invalidate();
+            }
+
+            void stop() {
+                if (fd == -1)
+                    return;
+                sigaction(SIGWINCH, &saved_resize_action, nullptr);
+                write_output(ANSI_COLOR_FOREGROUND_RESET "\x1b[?25h\x1b[?1049l");
+                tcsetattr(fd, TCSAFLUSH, &saved_mode);
+                close(fd);
+                fd = -1;
+            }
+
+            // Reads the terminal size again, returns true if it changed (the screen is cleared then)
+            bool update_size() {
+                struct winsize size {};
+                if (fd == -1 || ioctl(fd, TIOCGWINSZ, &size) == -1 || size.ws_col == 0 || size.ws_row == 0)
+                    return false;
+                if (size.ws_col == cols && size.ws_row == rows && buffer.cols() == cols)
+                    return false;
+                cols = size.ws_col;
+                rows = size.ws_row;
+                buffer.resize(cols, rows);
+                return true;
+            }
+
+            void clear() {
+                buffer.clear();
             }
 
             void write(int x, int y, char c) {
                 write_char(x, y, c, true);
             }
 
-            void write(int x, int y, std::string s) {
-                for (unsigned int i = 0; i < s.length(); i++)
-                    write_char(x + i, y, s[i], false);
-                //redraw();
+            // Clipped at the end of the row, returns the number of cells written
+            int write(int x, int y, std::string s, const console::style cell_style = console::style::normal) {
+                return buffer.write(x, y, s, cell_style);
+            }
+
+            void redraw() {
+                write_output(buffer.render());
+            }
+
+            // Waits up to 'timeout_ms' for a key press (infinite if negative), console::key::none if none was pressed or the terminal was resized
+            console::key_event_t read_key(const int timeout_ms) {
+                if (input_offset >= input.length()) {
+                    input.clear();
+                    input_offset = 0;
+                    struct pollfd pfds[2] {{fd, POLLIN, 0}, {resize_pipe[0], POLLIN, 0}};
+                    if (poll(pfds, 2, timeout_ms) <= 0)
+                        return console::key_event_t{console::key::none, '\0'};
+                    char temp[64];
+                    if (pfds[1].revents & POLLIN) {
+                        while (read(resize_pipe[0], temp, sizeof(temp)) > 0);
+                        return console::key_event_t{console::key::none, '\0'};
+                    }
+                    const ssize_t length { read(fd, temp, sizeof(temp)) };
+                    if (length <= 0)
+                        return console::key_event_t{console::key::none, '\0'};
+                    input.assign(temp, length);
+                }
+                return parse_key(input, input_offset);
             }
     };
 }
@@ -3,12 +3,34 @@
 
 #include <string>
 #include <vector>
+#include <set>
+#include <algorithm>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <string_view>
 #include <stdexcept>
 
 #include <dirent.h>
+#include <fcntl.h> // openat()
 #include <sys/stat.h>
+#include <sys/resource.h> // setrlimit()
+#include <sys/syscall.h> // SYS_getdents64
 #include <unistd.h> // getcwd()
 #include <stdlib.h> // getenv()
+#include <sys/sysmacros.h> // makedev()
+#include <sys/mman.h> // mmap()
+#include <string.h> // memcmp()
+#include <time.h>
+
+#include "sharded_set.hpp"
+
+#ifdef STATX_TYPE
+#include "uring.hpp"
+#endif
 
 namespace fs {
     enum class file_type {
@@ -27,14 +49,39 @@ namespace fs {
         invalid_path,
         file_not_found,
         permission_denied,
-        undefined
+        undefined,
+        incomplete // scan cancelled before all entries below were read, the length is a lower bound
+    };
+
+    // Metadata fields of file_stat_t, used to request and validate stat results
+    enum file_field : unsigned int {
+        field_none = 0x00,
+        field_type = 0x01,
+        field_mode = 0x02,
+        field_owner = 0x04, // uid and gid
+        field_length = 0x08,
+        field_access_time = 0x10,
+        field_modify_time = 0x20,
+        field_change_time = 0x40,
+        field_links = 0x80, // inode and link count
+        field_all = 0xFF
     };
 
-    struct file_info_t {
+    enum class io_backend {
+        sync, // one blocking statx() per entry
+        uring // statx() of a whole directory batched through io_uring
+    };
+
+    enum class stat_order {
+        readdir, // as listed by the file system (e.g. hash order on ext4)
+        inode // sorted by inode number, keeps inode table reads mostly sequential
+    };
+
+    // Metadata of a file as returned by stat, without its location
+    struct file_stat_t {
         fs::file_error error;
+        unsigned int fields; // fs::file_field values which are valid
         fs::file_type type;
-        std::string path;
-        std::string name;
         unsigned int mode;
         unsigned int uid;
         unsigned int gid;
@@ -42,8 +89,55 @@ namespace fs {
         unsigned int access_time;
         unsigned int modify_time;
         unsigned int change_time;
+        unsigned long device; // always valid if error is none
+        unsigned long inode;
+        unsigned int links;
+    };
+
+    struct file_info_t : fs::file_stat_t {
+        std::string path;
+        std::string name;
     };
 
+    struct inode_t {
+        unsigned long device;
+        unsigned long inode;
+
+        bool operator==(const inode_t &other) const {
+            return device == other.device && inode == other.inode;
+        }
+    };
+
+    struct inode_hash_t {
+        std::size_t operator()(const inode_t &value) const {
+            return std::hash<unsigned long>{}(value.inode ^ (value.device << 32) ^ (value.device >> 32));
+        }
+    };
+
+    // Hard link aware accounting, shared between all threads of a scan
+    struct link_accounting_t {
+        threading::sharded_set<fs::inode_t, fs::inode_hash_t> charged_inodes {};
+        std::atomic_ulong apparent_length {0}; // every link counted
+    };
+
+    /*
+        Files with more than one hard link are only charged for the first link
+        seen during the scan, the lengths of the others are set to zero. Only
+        these files hit the shared inode set. Requires the
+        fs::file_field::field_links field.
+    */
+    void charge_once(const std::vector<fs::file_stat_t *> &files, fs::link_accounting_t &accounting) {
+        unsigned long apparent_length {0};
+        for (fs::file_stat_t *fi: files) {
+            apparent_length += fi->length;
+            if (fi->type == fs::file_type::directory || !(fi->fields & fs::file_field::field_links) || fi->links <= 1)
+                continue;
+            if (!accounting.charged_inodes.insert(fs::inode_t{fi->device, fi->inode}))
+                fi->length = 0;
+        }
+        accounting.apparent_length += apparent_length;
+    }
+
     /*
         File mode bits:
            S_ISUID     04000   set-user-ID bit
@@ -92,6 +186,16 @@ namespace fs {
         return path.substr(pos_last_backslash + 1);
     }
 
+    // Resolves symbolic links and relative components, returns the given path on failure
+    std::string real_path(const std::string &path) {
+        char *temp { realpath(path.c_str(), nullptr) };
+        if (temp == nullptr)
+            return path;
+        std::string result(temp);
+        free(temp);
+        return result;
+    }
+
     std::string current_working_directory() {
         char buffer[255];
         const char *temp { getcwd(buffer, 255) };
@@ -117,7 +221,7 @@ namespace fs {
         return current_working_directory() + '/' + path;
     }
 
-    bool is_authorized(const fs::file_info_t &file, const fs::permission_flag &evaluation) {
+    bool is_authorized(const fs::file_stat_t &file, const fs::permission_flag &evaluation) {
         if (((file.mode & 0x07) & evaluation) == evaluation)
             return true;
 
@@ -134,76 +238,538 @@ namespace fs {
         return false;
     }
 
-    fs::file_info_t read_file(const std::string &path) {
-        fs::file_info_t fi;
-        fi.path = fs::dirname(path);
-        fi.name = fs::basename(path);
+    // Error of a directory given the error of one of its entries, incomplete subtrees take precedence
+    void propagate_error(fs::file_error &error, const fs::file_error entry_error) {
+        if (entry_error == fs::file_error::incomplete || (entry_error == fs::file_error::permission_denied && error != fs::file_error::incomplete))
+            error = entry_error;
+    }
 
-        struct stat sb;
-        if (lstat((fi.path + '/' + fi.name).c_str(), &sb) == -1) {
-            // Failed to stat file
-            switch (errno) {
-                case ENOENT: // A component of path does not name an existing file or path is an empty string.
-                    fi.error = fs::file_error::file_not_found;
-                    break;
-                case EACCES: // A component of the path prefix denies search permission.
-                    fi.error = fs::file_error::permission_denied;
-                    break;
-                case ELOOP: // A loop exists in symbolic links encountered during resolution of the path argument.
-                case ENAMETOOLONG: // The length of a pathname exceeds {PATH_MAX} or a pathname component is longer than {NAME_MAX}.
-                case ENOTDIR: // A component of the path prefix is not a directory.
-                    fi.error = fs::file_error::invalid_path;
-                    break;
-                case EIO: // An error occurred while reading from the file system.
-                case EOVERFLOW: // The file size in bytes or the number of blocks allocated cannot be represented correctly in the structure pointed to by buf.
-                    fi.error = fs::file_error::undefined;
-                    break;
-            }
-            fi.length = 0;
-            fi.type = fs::file_type::unknown;
-            return fi;
+    fs::file_error to_file_error(const int error) {
+        switch (error) {
+            case ENOENT: // A component of path does not name an existing file or path is an empty string.
+                return fs::file_error::file_not_found;
+            case EACCES: // A component of the path prefix denies search permission.
+                return fs::file_error::permission_denied;
+            case ELOOP: // A loop exists in symbolic links encountered during resolution of the path argument.
+            case ENAMETOOLONG: // The length of a pathname exceeds {PATH_MAX} or a pathname component is longer than {NAME_MAX}.
+            case ENOTDIR: // A component of the path prefix is not a directory.
+                return fs::file_error::invalid_path;
+            case EIO: // An error occurred while reading from the file system.
+            case EOVERFLOW: // The file size in bytes or the number of blocks allocated cannot be represented correctly in the structure pointed to by buf.
+            default:
+                return fs::file_error::undefined;
         }
+    }
 
-        fi.error = fs::file_error::none;
-        fi.length = sb.st_size;
-        switch (sb.st_mode & S_IFMT) {
+    fs::file_type to_file_type(const mode_t mode) {
+        switch (mode & S_IFMT) {
             case S_IFBLK:
-                fi.type = fs::file_type::block_device;
-                break;
+                return fs::file_type::block_device;
             case S_IFCHR:
-                fi.type = fs::file_type::character_device;
-                break;
+                return fs::file_type::character_device;
             case S_IFDIR:
-                fi.type = fs::file_type::directory;
-                break;
+                return fs::file_type::directory;
             case S_IFIFO:
-                fi.type = fs::file_type::fifo;
-                break;
+                return fs::file_type::fifo;
             case S_IFLNK:
-                fi.type = fs::file_type::symlink;
-                break;
+                return fs::file_type::symlink;
             case S_IFREG:
-                fi.type = fs::file_type::file;
-                break;
+                return fs::file_type::file;
             case S_IFSOCK:
-                fi.type = fs::file_type::socket;
-                break;
+                return fs::file_type::socket;
             default:
-                fi.type = fs::file_type::unknown;
-                break;
+                return fs::file_type::unknown;
+        }
+    }
+
+    // Directories lacking read permission are otherwise detected when opened
+    void check_authorization(fs::file_stat_t &fi, const unsigned int fields) {
+        const unsigned int authorization_fields { fs::file_field::field_mode | fs::file_field::field_owner };
+        if (fi.type == fs::file_type::directory && (fields & fi.fields & authorization_fields) == authorization_fields && !fs::is_authorized(fi, fs::permission_flag::read))
+            fi.error = fs::file_error::permission_denied;
+    }
+
+    void set_file_error(fs::file_stat_t &fi, const int error) {
+        fi.error = fs::to_file_error(error);
+        fi.fields = fs::file_field::field_none;
+        fi.length = 0;
+        fi.type = fs::file_type::unknown;
+    }
+
+#ifdef STATX_TYPE
+    unsigned int to_statx_mask(const unsigned int fields) {
+        unsigned int mask { STATX_TYPE };
+        if (fields & fs::file_field::field_mode) mask |= STATX_MODE;
+        if (fields & fs::file_field::field_owner) mask |= STATX_UID | STATX_GID;
+        if (fields & fs::file_field::field_length) mask |= STATX_SIZE;
+        if (fields & fs::file_field::field_access_time) mask |= STATX_ATIME;
+        if (fields & fs::file_field::field_modify_time) mask |= STATX_MTIME;
+        if (fields & fs::file_field::field_change_time) mask |= STATX_CTIME;
+        if (fields & fs::file_field::field_links) mask |= STATX_INO | STATX_NLINK;
+        return mask;
+    }
+
+    void set_file_info(fs::file_stat_t &fi, const struct statx &sx, const unsigned int fields) {
+        fi.error = fs::file_error::none;
+        fi.fields = fs::file_field::field_none;
+        fi.length = 0;
+        fi.type = fs::file_type::unknown;
+        fi.device = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+        if (sx.stx_mask & STATX_TYPE) {
+            fi.type = fs::to_file_type(sx.stx_mode);
+            fi.fields |= fs::file_field::field_type;
         }
+        if (sx.stx_mask & STATX_MODE) {
+            fi.mode = sx.stx_mode;
+            fi.fields |= fs::file_field::field_mode;
+        }
+        if ((sx.stx_mask & (STATX_UID | STATX_GID)) == (STATX_UID | STATX_GID)) {
+            fi.uid = sx.stx_uid;
+            fi.gid = sx.stx_gid;
+            fi.fields |= fs::file_field::field_owner;
+        }
+        if (sx.stx_mask & STATX_SIZE) {
+            fi.length = sx.stx_size;
+            fi.fields |= fs::file_field::field_length;
+        }
+        if (sx.stx_mask & STATX_ATIME) {
+            fi.access_time = sx.stx_atime.tv_sec;
+            fi.fields |= fs::file_field::field_access_time;
+        }
+        if (sx.stx_mask & STATX_MTIME) {
+            fi.modify_time = sx.stx_mtime.tv_sec;
+            fi.fields |= fs::file_field::field_modify_time;
+        }
+        if (sx.stx_mask & STATX_CTIME) {
+            fi.change_time = sx.stx_ctime.tv_sec;
+            fi.fields |= fs::file_field::field_change_time;
+        }
+        if ((sx.stx_mask & (STATX_INO | STATX_NLINK)) == (STATX_INO | STATX_NLINK)) {
+            fi.inode = sx.stx_ino;
+            fi.links = sx.stx_nlink;
+            fi.fields |= fs::file_field::field_links;
+        }
+        fs::check_authorization(fi, fields);
+    }
+#endif
+
+    void set_file_info(fs::file_stat_t &fi, const struct stat &sb, const unsigned int fields) {
+        fi.error = fs::file_error::none;
+        fi.fields = fs::file_field::field_all;
+        fi.length = sb.st_size;
+        fi.type = fs::to_file_type(sb.st_mode);
         fi.mode = sb.st_mode;
         fi.uid = sb.st_uid;
         fi.gid = sb.st_gid;
         fi.access_time = sb.st_atime;
         fi.modify_time = sb.st_mtime;
         fi.change_time = sb.st_ctime;
+        fi.device = sb.st_dev;
+        fi.inode = sb.st_ino;
+        fi.links = sb.st_nlink;
+        fs::check_authorization(fi, fields);
+    }
 
-        if (fi.type == fs::file_type::directory && !fs::is_authorized(fi, fs::permission_flag::read))
-            fi.error = fs::file_error::permission_denied;
+    /*
+        Stat file relative to the directory descriptor, only the requested
+        fields are asked for. Uses statx() with AT_STATX_DONT_SYNC when
+        available, which lets network file systems (NFS, CephFS, ...) answer
+        from cached attributes instead of a round-trip to the server.
+    */
+    void stat_file(fs::file_stat_t &fi, const int dirfd, const char *name, const int flags, const unsigned int fields) {
+#ifdef STATX_TYPE
+        static std::atomic_bool statx_supported {true};
+        if (statx_supported.load(std::memory_order_relaxed)) {
+            struct statx sx;
+            if (statx(dirfd, name, flags | AT_STATX_DONT_SYNC, fs::to_statx_mask(fields), &sx) == 0) {
+                fs::set_file_info(fi, sx, fields);
+                return;
+            }
+            if (errno != ENOSYS) {
+                fs::set_file_error(fi, errno);
+                return;
+            }
+            statx_supported.store(false, std::memory_order_relaxed); // Kernel older than 4.11, use fstatat() from now on
+        }
+#endif
+        struct stat sb;
+        if (fstatat(dirfd, name, &sb, flags) == -1) {
+            // Failed to stat file
+            fs::set_file_error(fi, errno);
+            return;
+        }
+        fs::set_file_info(fi, sb, fields);
+    }
+
+    fs::file_info_t read_file(const std::string &path, const unsigned int fields = fs::file_field::field_all) {
+        fs::file_info_t fi {};
+        fi.path = fs::dirname(path);
+        fi.name = fs::basename(path);
+
+        fs::stat_file(fi, AT_FDCWD, (fi.path + '/' + fi.name).c_str(), AT_SYMLINK_NOFOLLOW, fields);
+        return fi;
+    }
+
+    /*
+        Open directory handle. Children are resolved relative to the handle's
+        file descriptor (openat/fstatat), hence the kernel only has to look up
+        a single path component per entry instead of walking the full path.
+    */
+    class directory {
+        private:
+            const int fd;
+
+        public:
+            const std::string path;
+            const unsigned long root_device; // device of the directory the traversal started at
+
+            directory() = delete;
+            directory(const directory &) = delete;
+            directory &operator=(const directory &) = delete;
+
+            directory(const int fd_, const std::string &path_, const unsigned long root_device_) : fd(fd_), path(path_), root_device(root_device_) {}
+
+            ~directory() {
+                close(fd);
+            }
+
+            int descriptor() const {
+                return fd;
+            }
+    };
+
+    // Returns nullptr on failure, errno describes the error
+    std::shared_ptr<fs::directory> open_directory(const std::string &path) {
+        const int fd { open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+        if (fd == -1)
+            return nullptr;
+        struct stat sb;
+        if (fstat(fd, &sb) == -1) {
+            const int error { errno };
+            close(fd);
+            errno = error;
+            return nullptr;
+        }
+        return std::make_shared<fs::directory>(fd, path, sb.st_dev);
+    }
+
+    // Returns nullptr on failure, errno describes the error
+    std::shared_ptr<fs::directory> open_directory(const fs::directory &parent, const std::string &name) {
+        const int fd { openat(parent.descriptor(), name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC) };
+        if (fd == -1)
+            return nullptr;
+        if (parent.path.length() > 0 && parent.path.back() == '/')
+            return std::make_shared<fs::directory>(fd, parent.path + name, parent.root_device);
+        return std::make_shared<fs::directory>(fd, parent.path + '/' + name, parent.root_device);
+    }
+
+    fs::file_info_t read_file(const fs::directory &dir, const std::string &name, const unsigned int fields = fs::file_field::field_all) {
+        fs::file_info_t fi {};
+        fi.path = dir.path;
+        fi.name = name;
+
+        fs::stat_file(fi, dir.descriptor(), name.c_str(), AT_SYMLINK_NOFOLLOW, fields);
+        return fi;
+    }
+
+    fs::file_info_t read_file(const fs::directory &dir, const unsigned int fields = fs::file_field::field_all) {
+        fs::file_info_t fi {};
+        fi.path = fs::dirname(dir.path);
+        fi.name = fs::basename(dir.path);
+
+        fs::stat_file(fi, dir.descriptor(), "", AT_EMPTY_PATH, fields);
         return fi;
     }
 
+#ifdef STATX_TYPE
+    struct uring_context_t {
+        uring::ring ring;
+        std::vector<struct statx> buffers; // one per submission queue slot
+        std::vector<std::size_t> slot_files; // index of file being stat'ed per slot
+        std::vector<unsigned int> free_slots;
+
+        uring_context_t(const unsigned int entries) : ring(entries) {
+            buffers.resize(ring.capacity());
+            slot_files.resize(ring.capacity());
+            for (unsigned int slot = 0; slot < ring.capacity(); slot++)
+                free_slots.push_back(slot);
+        }
+    };
+
+    // Returns nullptr if io_uring is not usable, the synchronous path is then used
+    fs::uring_context_t *get_uring_context() {
+        if (!uring::supported())
+            return nullptr;
+
+        thread_local std::unique_ptr<fs::uring_context_t> context {nullptr};
+        thread_local bool failed {false};
+        if (context == nullptr && !failed) {
+            try {
+                context = std::make_unique<fs::uring_context_t>(256);
+            }
+            catch (const std::runtime_error &) {
+                failed = true; // e.g. locked memory limit reached
+            }
+        }
+        return context.get();
+    }
+#endif
+
+    /*
+        Stat the given files of a directory, names[i] being the name of
+        files[i]. With fs::io_backend::uring the statx() calls are queued as
+        one batch of io_uring submissions and the completions are collected as
+        they arrive, instead of one blocking system call per file. With
+        fs::stat_order::inode the files are stat'ed by ascending inode number
+        as reported while listing them.
+    */
+    void stat_files(const fs::directory &dir, const std::vector<fs::file_stat_t *> &files, const std::vector<const char *> &names, const unsigned int fields, const fs::io_backend backend, const fs::stat_order order = fs::stat_order::readdir) {
+        if (order == fs::stat_order::inode) {
+            std::vector<std::size_t> sorted(files.size());
+            for (std::size_t i = 0; i < sorted.size(); i++)
+                sorted[i] = i;
+            std::sort(sorted.begin(), sorted.end(), [&files] (const std::size_t a, const std::size_t b) { return files[a]->inode < files[b]->inode; });
+            std::vector<fs::file_stat_t *> sorted_files(files.size());
+            std::vector<const char *> sorted_names(files.size());
+            for (std::size_t i = 0; i < sorted.size(); i++) {
+                sorted_files[i] = files[sorted[i]];
+                sorted_names[i] = names[sorted[i]];
+            }
+            stat_files(dir, sorted_files, sorted_names, fields, backend, fs::stat_order::readdir);
+            return;
+        }
+
+#ifdef STATX_TYPE
+        fs::uring_context_t *context { backend == fs::io_backend::uring ? fs::get_uring_context() : nullptr };
+        if (context != nullptr) {
+            const unsigned int mask { fs::to_statx_mask(fields) };
+            std::size_t next {0};
+            std::size_t completed {0};
+            while (completed < files.size()) {
+                while (next < files.size() && context->free_slots.size() > 0) {
+                    const unsigned int slot { context->free_slots.back() };
+                    context->free_slots.pop_back();
+                    context->slot_files[slot] = next;
+                    context->ring.prepare_statx(dir.descriptor(), names[next], AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, mask, &context->buffers[slot], slot);
+                    next++;
+                }
+
+                context->ring.submit(1);
+                completed += context->ring.reap([context, &files, fields] (const unsigned long slot, const int result) {
+                    fs::file_stat_t &fi { *files[context->slot_files[slot]] };
+                    if (result < 0)
+                        fs::set_file_error(fi, -result);
+                    else
+                        fs::set_file_info(fi, context->buffers[slot], fields);
+                    context->free_slots.push_back(slot);
+                });
+            }
+            return;
+        }
+#else
+        (void)backend;
+#endif
+        for (std::size_t i = 0; i < files.size(); i++)
+            fs::stat_file(*files[i], dir.descriptor(), names[i], AT_SYMLINK_NOFOLLOW, fields);
+    }
+
+    struct mount_t {
+        unsigned long device;
+        std::string path;
+        std::string type;
+    };
+
+    // Decodes the octal escapes (e.g. \040 for space) of /proc/self/mountinfo
+    std::string unescape_mount_path(const std::string &path) {
+        std::string result {};
+        for (std::size_t i = 0; i < path.length(); i++) {
+            if (path[i] == '\\' && i + 3 < path.length() && path[i + 1] >= '0' && path[i + 1] <= '3') {
+                result += static_cast<char>(((path[i + 1] - '0') << 6) | ((path[i + 2] - '0') << 3) | (path[i + 3] - '0'));
+                i += 3;
+            }
+            else {
+                result += path[i];
+            }
+        }
+        return result;
+    }
+
+    std::vector<fs::mount_t> read_mounts(const std::string &mountinfo = "/proc/self/mountinfo") {
+        std::vector<fs::mount_t> mounts {};
+        std::ifstream stream(mountinfo);
+        std::string line;
+        while (std::getline(stream, line)) {
+            // <id> <parent id> <major>:<minor> <root> <mount point> <options> [<optional>...] - <type> <source> <super options>
+            std::istringstream fields(line);
+            std::string id, parent_id, device, root, mount_point, options, field;
+            if (!(fields >> id >> parent_id >> device >> root >> mount_point >> options))
+                continue;
+            while (fields >> field && field != "-");
+            std::string type;
+            if (!(fields >> type))
+                continue;
+
+            const std::size_t separator { device.find(':') };
+            if (separator == std::string::npos)
+                continue;
+            const unsigned int major { static_cast<unsigned int>(std::stoul(device.substr(0, separator))) };
+            const unsigned int minor { static_cast<unsigned int>(std::stoul(device.substr(separator + 1))) };
+            mounts.push_back(fs::mount_t{makedev(major, minor), fs::unescape_mount_path(mount_point), type});
+        }
+        return mounts;
+    }
+
+    bool is_pseudo_or_network_file_system(const std::string &type) {
+        static const std::set<std::string> types {
+            // pseudo
+            "autofs", "binfmt_misc", "bpf", "cgroup", "cgroup2", "configfs", "debugfs", "devpts", "devtmpfs", "efivarfs",
+            "fusectl", "hugetlbfs", "mqueue", "nsfs", "proc", "pstore", "rpc_pipefs", "securityfs", "selinuxfs", "sysfs", "tracefs",
+            // network
+            "9p", "afs", "ceph", "cifs", "fuse.sshfs", "glusterfs", "lustre", "ncpfs", "nfs", "nfs4", "smb3", "smbfs"
+        };
+        return types.find(type) != types.end();
+    }
+
+    /*
+        Decides which subdirectories are entered during a traversal. Mount
+        points are looked up by path (from the mount table read at startup),
+        hence excluded file systems are skipped without touching them, which
+        also avoids triggering automounts or hanging on unreachable network
+        file systems. Targets themselves are always entered.
+    */
+    class mount_policy {
+        private:
+            const bool one_file_system;
+            const bool skip_pseudo_or_network;
+            std::unordered_map<std::string, std::unordered_map<std::string, fs::mount_t>> mount_points {}; // by parent path and name
+
+        public:
+            mount_policy(const std::vector<fs::mount_t> &mounts, const bool one_file_system_, const bool skip_pseudo_or_network_) : one_file_system(one_file_system_), skip_pseudo_or_network(skip_pseudo_or_network_) {
+                for (const auto &mount: mounts) {
+                    const std::size_t separator { mount.path.find_last_of('/') };
+                    if (separator == std::string::npos || separator == mount.path.length() - 1)
+                        continue; // root
+                    const std::string parent_path { separator == 0 ? "/" : mount.path.substr(0, separator) };
+                    mount_points[parent_path][mount.path.substr(separator + 1)] = mount; // note: last mount on a path wins
+                }
+            }
+
+            // Before the subdirectory is opened
+            bool may_enter(const fs::directory &parent, const std::string &name) const {
+                const auto parent_iterator = mount_points.find(parent.path);
+                if (parent_iterator == mount_points.end())
+                    return true;
+                const auto mount_iterator = parent_iterator->second.find(name);
+                if (mount_iterator == parent_iterator->second.end())
+                    return true;
+
+                const fs::mount_t &mount { mount_iterator->second };
+                if (skip_pseudo_or_network && fs::is_pseudo_or_network_file_system(mount.type))
+                    return false;
+                return !one_file_system || mount.device == parent.root_device;
+            }
+
+            // After the subdirectory is opened, catches mount points not found by path
+            bool may_enter(const fs::directory &dir) const {
+                if (!one_file_system)
+                    return true;
+                struct stat sb;
+                return fstat(dir.descriptor(), &sb) == 0 && static_cast<unsigned long>(sb.st_dev) == dir.root_device;
+            }
+    };
+
+    struct dirent_t {
+        ino64_t inode;
+        fs::file_type type; // fs::file_type::unknown if not reported by the file system
+        std::string_view name;
+    };
+
+    struct dirent_buffer_t {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+        bool in_use;
+    };
+
+    /*
+        Read directory entries with getdents64() into a per-thread buffer which
+        is reused for every directory. The buffer doubles (up to 4 MiB) each
+        time a single call fills more than half of it, hence huge directories
+        are read in few system calls. The entry names point into the buffer and
+        are only valid during the callback. Returns false on failure, errno
+        describes the error.
+    */
+    template<typename T> bool read_entries(const fs::directory &dir, T callback) {
+        constexpr std::size_t min_buffer_size {32 * 1024};
+        constexpr std::size_t max_buffer_size {4 * 1024 * 1024};
+
+        thread_local fs::dirent_buffer_t shared_buffer {nullptr, 0, false};
+        fs::dirent_buffer_t local_buffer {nullptr, 0, false};
+        fs::dirent_buffer_t &buffer = shared_buffer.in_use ? local_buffer : shared_buffer; // Nested calls get a buffer of their own
+        if (buffer.size == 0) {
+            buffer.data.reset(new char[min_buffer_size]);
+            buffer.size = min_buffer_size;
+        }
+
+        struct buffer_guard_t {
+            fs::dirent_buffer_t &buffer;
+            buffer_guard_t(fs::dirent_buffer_t &buffer_) : buffer(buffer_) { buffer.in_use = true; }
+            ~buffer_guard_t() { buffer.in_use = false; }
+        } buffer_guard {buffer};
+
+        if (lseek(dir.descriptor(), 0, SEEK_SET) == -1)
+            return false;
+
+        while (true) {
+            const long bytes { syscall(SYS_getdents64, dir.descriptor(), buffer.data.get(), buffer.size) };
+            if (bytes == -1)
+                return false;
+            if (bytes == 0)
+                return true;
+
+            for (long offset = 0; offset < bytes;) {
+                const struct dirent64 *entry { reinterpret_cast<const struct dirent64 *>(buffer.data.get() + offset) };
+                offset += entry->d_reclen;
+
+                const char *name { entry->d_name };
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                    continue; // Skip virtual paths
+
+                callback(fs::dirent_t{entry->d_ino, fs::to_file_type(DTTOIF(entry->d_type)), std::string_view(name)});
+            }
+
+            if (static_cast<std::size_t>(bytes) > buffer.size / 2 && buffer.size < max_buffer_size) {
+                buffer.size *= 2;
+                buffer.data.reset(new char[buffer.size]);
+            }
+        }
+    }
+
+    // Every directory being traversed holds an open file descriptor
+    void raise_descriptor_limit() {
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == -1 || limit.rlim_cur == limit.rlim_max)
+            return;
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    /*
+        Whether the block device backing the given device number reports
+        itself as rotational. Partitions have no queue of their own, the one
+        of the parent disk is used then. Devices without a block device (e.g.
+        tmpfs, network file systems) are not rotational.
+    */
+    bool is_rotational(const unsigned long device) {
+        const std::string block { "/sys/dev/block/" + std::to_string(major(device)) + ':' + std::to_string(minor(device)) };
+        for (const std::string &queue: {block + "/queue/rotational", block + "/../queue/rotational"}) {
+            std::ifstream file(queue);
+            int rotational {0};
+            if (file >> rotational)
+                return rotational != 0;
+        }
+        return false;
+    }
+
     bool exists(const std::string &path) {
         fs::file_info_t fi = read_file(path);
         return (fi.error != fs::file_error::file_not_found && fi.error != fs::file_error::invalid_path);
@@ -214,54 +780,238 @@ namespace fs {
         return (fi.error == fs::file_error::none && fi.type == T);
     }
 
-    std::vector<fs::file_info_t> read_directory(const std::string &path, bool enter_directory, bool calculate_directory_length) {
-        std::vector<fs::file_info_t> contents;
-
-        DIR *dp {nullptr};
-        if((dp  = opendir(path.c_str())) == nullptr) {
-            if (!fs::exists(path))
-                throw std::runtime_error("Directory not found: " + path);
-            else
-                return contents; // Probably no permissions to read directory contents
+    // Identity and modification state of a directory, a changed listing changes its mtime/ctime
+    struct directory_stamp_t {
+        unsigned long device;
+        unsigned long inode;
+        long modify_seconds;
+        long modify_nanoseconds;
+        long change_seconds;
+        long change_nanoseconds;
+
+        bool operator<(const directory_stamp_t &other) const {
+            return device < other.device || (device == other.device && inode < other.inode);
         }
+    };
 
-        fs::file_info_t fi_root = read_file(path);
-        if (fi_root.type != fs::file_type::directory)
-            throw new std::runtime_error("Path is not a directory: " + path);
+    /*
+        Persistent cache of directory listings, keyed by device and inode of
+        the directory. A listing is reused as long as the mtime and ctime of
+        its directory are unchanged, the entries are still stat'ed. The file
+        is mapped as is: a header, the directories sorted by device and inode,
+        their entries and the names. Directories changed shortly before the
+        scan started are not stored, a change within the same timestamp tick
+        would go unnoticed otherwise.
+    */
+    class scan_cache {
+        private:
+            struct header_t {
+                char magic[8];
+                unsigned long version;
+                unsigned long directory_count;
+                unsigned long entry_count;
+                unsigned long names_length;
+            };
+
+            struct directory_t {
+                fs::directory_stamp_t stamp;
+                unsigned long first_entry;
+                unsigned long entry_count;
+            };
+
+            struct entry_t {
+                unsigned long inode;
+                unsigned long name_offset;
+                unsigned int name_length;
+                fs::file_type type;
+            };
+
+            static constexpr char magic[8] {'d', 'u', 's', 'c', 'a', 'c', 'h', 'e'};
+            static constexpr unsigned long version {2};
+            const std::string path;
+            const long racy_seconds;
+            const time_t start_time { time(nullptr) };
+
+            // mapped cache of the previous scan
+            void *mapping {MAP_FAILED};
+            std::size_t mapping_size {0};
+            const directory_t *directories {nullptr};
+            const entry_t *entries {nullptr};
+            const char *names {nullptr};
+            header_t header {};
+
+            // listings recorded by this scan
+            std::mutex recorded_mutex {};
+            std::vector<directory_t> recorded_directories {};
+            std::vector<entry_t> recorded_entries {};
+            std::string recorded_names {};
+
+            bool map(const int fd) {
+                struct stat sb;
+                if (fstat(fd, &sb) == -1 || static_cast<std::size_t>(sb.st_size) < sizeof(header_t))
+                    return false;
+                mapping_size = sb.st_size;
+                mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED)
+                    return false;
+
+                header = *static_cast<const header_t *>(mapping);
+                const std::size_t expected_size { sizeof(header_t) + header.directory_count * sizeof(directory_t) + header.entry_count * sizeof(entry_t) + header.names_length };
+                if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || expected_size != mapping_size)
+                    return false;
+
+                directories = reinterpret_cast<const directory_t *>(static_cast<const char *>(mapping) + sizeof(header_t));
+                entries = reinterpret_cast<const entry_t *>(directories + header.directory_count);
+                names = reinterpret_cast<const char *>(entries + header.entry_count);
+                return true;
+            }
+
+            const directory_t *find(const fs::directory_stamp_t &stamp) const {
+                const directory_t *end { directories + header.directory_count };
+                const directory_t *found { std::lower_bound(directories, end, stamp, [] (const directory_t &d, const fs::directory_stamp_t &s) { return d.stamp < s; }) };
+                if (found == end || found->stamp < stamp || stamp < found->stamp)
+                    return nullptr;
+                if (found->stamp.modify_seconds != stamp.modify_seconds || found->stamp.modify_nanoseconds != stamp.modify_nanoseconds || found->stamp.change_seconds != stamp.change_seconds || found->stamp.change_nanoseconds != stamp.change_nanoseconds)
+                    return nullptr; // Directory changed since
+                if (found->first_entry + found->entry_count > header.entry_count)
+                    return nullptr;
+                return found;
+            }
+
+        public:
+            std::atomic_ulong hits {0};
+            std::atomic_ulong misses {0};
+
+            scan_cache() = delete;
+            scan_cache(const scan_cache &) = delete;
+            scan_cache &operator=(const scan_cache &) = delete;
+
+            // A missing or invalid cache file is treated as an empty cache, 'racy_seconds' is the coarsest timestamp granularity expected (FAT)
+            scan_cache(const std::string &path_, const long racy_seconds_ = 2) : path(path_), racy_seconds(racy_seconds_) {
+                const int fd { open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+                if (fd == -1)
+                    return;
+                if (!map(fd))
+                    header = header_t{};
+                close(fd);
+            }
 
-        if (!enter_directory) {
-            if (calculate_directory_length) {
-                for (const auto &fi_child: read_directory(path, true, true)) {
-                    if (fi_child.error == fs::file_error::permission_denied)
-                        fi_root.error = fs::file_error::permission_denied;
-                    fi_root.length += fi_child.length;
+            ~scan_cache() {
+                if (mapping != MAP_FAILED)
+                    munmap(mapping, mapping_size);
+            }
+
+            /*
+                Lists the entries of the directory from the cache if it is
+                unchanged, from the file system otherwise. The stamp is taken
+                before listing and is to be handed to record(). Returns false
+                on failure, errno describes the error.
+            */
+            template<typename T> bool read_entries(const fs::directory &dir, fs::directory_stamp_t &stamp, T callback) {
+                struct stat sb;
+                if (fstat(dir.descriptor(), &sb) == -1)
+                    return false;
+                stamp = fs::directory_stamp_t{static_cast<unsigned long>(sb.st_dev), static_cast<unsigned long>(sb.st_ino), sb.st_mtim.tv_sec, sb.st_mtim.tv_nsec, sb.st_ctim.tv_sec, sb.st_ctim.tv_nsec};
+
+                const directory_t *cached { find(stamp) };
+                if (cached == nullptr) {
+                    misses++;
+                    return fs::read_entries(dir, callback);
+                }
+
+                hits++;
+                for (unsigned long i = cached->first_entry; i < cached->first_entry + cached->entry_count; i++) {
+                    const entry_t &entry { entries[i] };
+                    if (entry.name_offset + entry.name_length > header.names_length)
+                        continue; // Corrupt entry
+                    callback(fs::dirent_t{entry.inode, entry.type, std::string_view(names + entry.name_offset, entry.name_length)});
                 }
+                return true;
             }
-            contents.push_back(std::move(fi_root));
-            return contents;
-        }
 
-        struct dirent *dirp {nullptr};
-        while ((dirp = readdir(dp)) != nullptr) {
-            std::string filename { std::string(dirp->d_name) };
-            if (filename == "." || filename == "..")
-                continue; // Skip virtual paths
+            // Stores the listing of the directory for the next scan
+            void record(const fs::directory_stamp_t &stamp, const std::vector<fs::dirent_t> &listing) {
+                if (stamp.change_seconds + racy_seconds > start_time || stamp.modify_seconds + racy_seconds > start_time)
+                    return; // Changed too recently to be trusted
 
-            fs::file_info_t fi_child = read_file(path + '/' + filename);
+                std::lock_guard<std::mutex> recorded_lock(recorded_mutex);
+                recorded_directories.push_back(directory_t{stamp, recorded_entries.size(), listing.size()});
+                for (const auto &entry: listing) {
+                    recorded_entries.push_back(entry_t{entry.inode, recorded_names.length(), static_cast<unsigned int>(entry.name.length()), entry.type});
+                    recorded_names += entry.name;
+                }
+            }
 
-            if (calculate_directory_length && fi_child.type == fs::file_type::directory) {
-                for (const auto &fi_grandchild: read_directory(path + '/' + filename, enter_directory, true)) {
-                    if (fi_grandchild.error == fs::file_error::permission_denied)
-                        fi_child.error = fs::file_error::permission_denied;
-                    fi_child.length += fi_grandchild.length;
+            // Replaces the cache file by the listings recorded during this scan
+            void save() {
+                std::lock_guard<std::mutex> recorded_lock(recorded_mutex);
+                std::sort(recorded_directories.begin(), recorded_directories.end(), [] (const directory_t &a, const directory_t &b) { return a.stamp < b.stamp; });
+                recorded_directories.erase(std::unique(recorded_directories.begin(), recorded_directories.end(), [] (const directory_t &a, const directory_t &b) { return !(a.stamp < b.stamp) && !(b.stamp < a.stamp); }), recorded_directories.end()); // e.g. bind mounts
+
+                header_t temp {};
+                memcpy(temp.magic, magic, sizeof(magic));
+                temp.version = version;
+                temp.directory_count = recorded_directories.size();
+                temp.entry_count = recorded_entries.size();
+                temp.names_length = recorded_names.length();
+
+                const std::string temp_path { path + ".tmp" };
+                {
+                    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+                    file.write(reinterpret_cast<const char *>(&temp), sizeof(temp));
+                    file.write(reinterpret_cast<const char *>(recorded_directories.data()), recorded_directories.size() * sizeof(directory_t));
+                    file.write(reinterpret_cast<const char *>(recorded_entries.data()), recorded_entries.size() * sizeof(entry_t));
+                    file.write(recorded_names.data(), recorded_names.length());
+                    if (!file.good())
+                        throw std::runtime_error("Failed to write cache: " + temp_path);
                 }
+                if (rename(temp_path.c_str(), path.c_str()) == -1)
+                    throw std::runtime_error("Failed to replace cache: " + path);
             }
+    };
 
-            contents.push_back(std::move(fi_child));
+    struct read_options_t {
+        unsigned int fields {fs::file_field::field_all};
+        fs::io_backend backend {fs::io_backend::sync};
+        fs::stat_order order {fs::stat_order::readdir};
+        const fs::mount_policy *policy {nullptr};
+    };
+
+    // Lists and stats the entries of the directory, subdirectories are not entered
+    std::vector<fs::file_info_t> read_directory(const fs::directory &dir, const fs::read_options_t &options = {}) {
+        std::vector<fs::file_info_t> contents;
+        const auto list_entry = [&dir, &contents] (const fs::dirent_t &entry) {
+            fs::file_info_t fi {};
+            fi.path = dir.path;
+            fi.name = std::string(entry.name);
+            fi.inode = entry.inode; // d_ino, sort key of fs::stat_order::inode
+            contents.push_back(std::move(fi));
+        };
+        if (!fs::read_entries(dir, list_entry))
+            return contents; // Probably no permissions to read directory contents
+
+        std::vector<fs::file_stat_t *> files {};
+        std::vector<const char *> names {};
+        files.reserve(contents.size());
+        names.reserve(contents.size());
+        for (auto &fi: contents) {
+            files.push_back(&fi);
+            names.push_back(fi.name.c_str());
         }
-        closedir(dp);
+        fs::stat_files(dir, files, names, options.fields, options.backend, options.order);
         return contents;
     }
+
+    std::vector<fs::file_info_t> read_directory(const std::string &path, const fs::read_options_t &options = {}) {
+        std::shared_ptr<fs::directory> dir = fs::open_directory(path);
+        if (dir == nullptr) {
+            if (!fs::exists(path))
+                throw std::runtime_error("Directory not found: " + path);
+            else
+                return {}; // Probably no permissions to read directory contents
+        }
+        return read_directory(*dir, options);
+    }
 }
 
 #endif //__FS_HPP_INCLUDED__
@@ -1,8 +1,14 @@
 #include "dus.hpp"
 #include "thread_pool.hpp"
 #include "fs.hpp"
+#include "node_tree.hpp"
+#include "snapshot.hpp"
 #include "pipes.hpp"
 #include "console.hpp"
+#include "sorting.hpp"
+#include "watch.hpp"
+#include "browser.hpp"
+#include "planning.hpp"
 
 #include <iomanip>
 #include <iostream>
@@ -11,29 +17,47 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <deque>
 #include <algorithm>
 #include <future>
+#include <memory>
+#include <fstream>
+#include <chrono>
+#include <thread>
 #include <math.h>
+#include <unistd.h> // isatty()
 
 void print_usage() {
-    std::cout << "usage: " << PROGRAM_NAME << " [-] [-0] [-c <count>] [--color] [-d] [-h] [i] [-n] [-s <size|name|atime|mtime|ctime>] [-t <milliseconds>] [<target file/directory>]" << std::endl;
+    std::cout << "usage: " << PROGRAM_NAME << " [-] [-0] [--browse] [--cache=<path>] [-c <count>] [--color] [-d] [--depth <levels>] [--export=<path>] [-h] [i] [--import=<path> [--import=<path>]] [--all-fs] [--io=<sync|uring>] [--stat-order=<auto|readdir|inode>] [--stat-benchmark] [-u] [--watch[=<fanotify|inotify>]] [-x] [-n] [-s <size|name|atime|mtime|ctime>] [-t <milliseconds>] [<target file/directory>]" << std::endl;
     std::cout << std::endl;
     std::cout << "List the contents of the given file/directory as graphs based on file sizes. If no target is given the current working directory is used." << std::endl;
     std::cout << std::endl;
     std::cout << "  -           Force read from stdin. Default is reading from stdin only performed if no target is given." << std::endl;
+    std::cout << "  --all-fs    Enter pseudo (proc, sysfs, ...) and network (nfs, cifs, ...) file systems mounted below the target(s). Default is skipping them." << std::endl;
     std::cout << "  -0          Use null character ('\\0') as target separator for stdin. Default is newline ('\\n')." << std::endl;
+    std::cout << "  --browse    Browse the scanned tree interactively instead of listing it; arrow keys enter and leave directories, 's' sorts, 'i' inverts, '/' filters, 'r' rescans the shown directory, 'q' or Ctrl-C quits. Only used if a single directory is entered." << std::endl;
+    std::cout << "  --cache=<path>  Reuse the directory listings of the previous scan stored at path, unchanged directories (by mtime/ctime) are not read again. The file is replaced by the listings of this scan." << std::endl;
     std::cout << "  -c <count>  Number of items to printout of result head. Default is infinite (-1)." << std::endl;
     std::cout << "  --color     Colorized output for easier interpretation." << std::endl;
     std::cout << "  -d          Don't enter directory. Only used if a single directory is defined as target." << std::endl;
+    std::cout << "  --depth <levels>  List the contents as a tree down to the given number of levels below the listed entries, sized relative to their parent. Entries below are only summed up while scanning. -c applies to each level. Default is no tree (0)." << std::endl;
     std::cout << "  -h          Print human readable sizes (e.g., 1K 234M 5G)." << std::endl;
+    std::cout << "  --export=<path>  Write the scanned tree to a snapshot file at path. Only used if a single directory is entered." << std::endl;
     std::cout << "  --help      Print this help and exit." << std::endl;
+    std::cout << "  --import=<path>  List the contents stored in a snapshot file instead of reading the file system, the target selects a directory of the snapshot. Given twice the changes from the first to the second snapshot are listed, sized by their difference ('-' for shrunk entries)." << std::endl;
     std::cout << "  -i          Inverted/reverted order of listed result. Default order is set by sort: -s." << std::endl;
+    std::cout << "  --io=<...>  I/O backend used to stat files; 'sync', 'uring' (batched through io_uring). Default is 'sync'." << std::endl;
     std::cout << "  -j <x>      Number of parallel jobs (threads) used while reading files and directory information. Default is 1." << std::endl;
     std::cout << "  -n          Enable natural sort order if sort order is a string representation. Default is disabled." << std::endl;
     std::cout << "  -s <...>    Sort by property; 'size', 'name', 'atime', 'mtime', 'ctime'. Default is 'size'." << std::endl;
-    std::cout << "  -t <ms>     File/directory parse timeout given in milliseconds. Default is infinite (-1)." << std::endl;
+    std::cout << "  --stat-order=<...>  Order in which the entries of a directory are stat'ed; 'readdir', 'inode' (sequential inode table reads), 'auto' (inode on rotational devices). Default is 'auto'." << std::endl;
+    std::cout << "  --stat-benchmark    Measure the stat throughput of the target(s) for each stat order and exit. If run as root, the dentry and inode caches of the whole system are dropped before each measurement (/proc/sys/vm/drop_caches)." << std::endl;
+    std::cout << "  -u          Count hard linked files only once. Both the deduplicated and the apparent total are printed." << std::endl;
+    std::cout << "  -t <ms>     File/directory parse timeout given in milliseconds. Once passed, no further directories are entered and the partial result is listed, entries marked '>' are lower bounds (exit status 3). Default is infinite (-1)." << std::endl;
     std::cout << "  --tsep=<c>  Add thousands seperator. Default is none." << std::endl;
     std::cout << "  --version   Print out version information." << std::endl;
+    std::cout << "  --watch[=<...>]  Keep the listing current until interrupted, driven by change events; 'fanotify' (one mark per file system, requires CAP_SYS_ADMIN), 'inotify' (one watch per directory). Default is fanotify if permitted, inotify otherwise. Only used if a single directory is entered." << std::endl;
+    std::cout << "  -x          Stay on the file system of each target, directories on other file systems are not entered." << std::endl;
     std::cout << std::endl;
     std::cout << "                  Copyright (C) " PROGRAM_YEAR ". Licensed under " PROGRAM_LICENSE "." << std::endl;
 }
@@ -97,6 +121,129 @@ int cmp_natural_order(const std::string &str1, const std::string &str2) {
         return -1;
 }
 
+// Result of parsing the contents of a directory, written by the directory's own task
+struct subtree_t {
+    unsigned long length;
+    fs::file_error error;
+    fs::node_id first_child;
+    unsigned int child_count;
+};
+
+// Directory entry being parsed, the name is interned in the node tree
+struct parse_entry_t {
+    fs::file_stat_t file;
+    const char *name;
+    fs::node_id node;
+    subtree_t subtree;
+    bool dispatched;
+};
+
+// Directory being parsed, deleted by its group's continuation once the tasks of its subdirectories completed
+struct directory_job_t {
+    std::shared_ptr<fs::directory> directory; // note: outlives the tasks since they open their directories relative to it
+    fs::node_id node;
+    subtree_t *subtree;
+    fs::node_arena *arena;
+    bool fold;
+    fs::name_blocks folded_names {4096}; // names of folded entries, released along with the job
+    std::deque<parse_entry_t> entries {}; // note: references stay valid while growing
+    fs::directory_stamp_t stamp {};
+    bool listed {false};
+    std::function<void ()> completed {}; // called once the subtree is aggregated
+    threading::task_group group;
+
+    directory_job_t(const std::function<void (directory_job_t &)> &aggregate, threading::task_group *parent_group) : group([this, &aggregate] { aggregate(*this); delete this; }, parent_group) {}
+};
+
+// Partial result of the running scan, rendered while waiting for it
+struct scan_progress_t {
+    std::atomic_ulong entry_count {0};
+    std::atomic_ulong length {0};
+    std::mutex mutex {};
+    std::map<unsigned long, fs::file_info_t> entries {}; // depth-0 rows, by node (entered directory) or by target index
+    std::set<unsigned long> pending {}; // entered directories of the rows whose subtree is not aggregated yet
+};
+
+// Printed entry, nested entries (--depth) are indented below their parent and sized relative to it
+struct tree_row_t {
+    fs::file_info_t file;
+    fs::node_id node; // expanded if kept in the node tree
+    unsigned int depth;
+    unsigned long parent_length;
+};
+
+// Stats every entry below the given directory serially, returns the number of entries
+unsigned long stat_tree(const fs::directory &dir, const fs::read_options_t &options) {
+    unsigned long count {0};
+    for (const auto &fi: fs::read_directory(dir, options)) {
+        count++;
+        if (fi.type != fs::file_type::directory)
+            continue;
+        if (options.policy != nullptr && !options.policy->may_enter(dir, fi.name))
+            continue;
+        std::shared_ptr<fs::directory> child = fs::open_directory(dir, fi.name);
+        if (child != nullptr && (options.policy == nullptr || options.policy->may_enter(*child)))
+            count += stat_tree(*child, options);
+    }
+    return count;
+}
+
+void benchmark_stat_order(const std::set<std::string> &targets, fs::read_options_t options) {
+    for (const auto &order: std::vector<std::pair<std::string, fs::stat_order>>{{"readdir", fs::stat_order::readdir}, {"inode", fs::stat_order::inode}}) {
+        sync();
+        std::ofstream drop_caches("/proc/sys/vm/drop_caches");
+        drop_caches << "2" << std::endl; // note: dentries and inodes only, the page cache is not read by stat
+        const bool cold { drop_caches.good() };
+
+        options.order = order.second;
+        unsigned long count {0};
+        const auto start_time = std::chrono::steady_clock::now();
+        for (const auto &target: targets) {
+            std::shared_ptr<fs::directory> directory = fs::open_directory(fs::real_path(target));
+            if (directory != nullptr)
+                count += stat_tree(*directory, options);
+        }
+        const std::chrono::duration<double, std::milli> elapsed_time = std::chrono::steady_clock::now() - start_time;
+
+        std::cout << order.first << " order: " << count << " entries in " << elapsed_time.count() << "ms, " << static_cast<unsigned long>(count / (elapsed_time.count() / 1000.0)) << " entries/s" << (cold ? " (cold cache)" : " (warm cache, dropping caches not permitted)") << std::endl;
+    }
+}
+
+// Contents of the target directory of a snapshot, given two snapshots the changes between them sized by their difference
+std::vector<fs::file_info_t> read_snapshots(const std::vector<std::string> &paths, const std::string &target, std::set<std::string> &shrunk_names) {
+    if (paths.size() > 2)
+        throw std::runtime_error("At most two snapshots can be compared");
+
+    std::vector<std::unique_ptr<fs::snapshot>> snapshots {};
+    std::vector<unsigned long> nodes {};
+    for (const auto &path: paths) {
+        snapshots.push_back(std::make_unique<fs::snapshot>(path));
+        if (target.length() > 0)
+            nodes.push_back(snapshots.back()->find(target));
+        else
+            nodes.push_back(snapshots.back()->root_count() > 0 ? 0 : fs::snapshot::no_node);
+    }
+
+    std::vector<fs::file_info_t> files {};
+    if (snapshots.size() == 1) {
+        if (nodes.front() == fs::snapshot::no_node)
+            throw std::runtime_error("Directory not found in snapshot: " + target);
+        for (unsigned int i = 0; i < snapshots.front()->child_count(nodes.front()); i++)
+            files.push_back(snapshots.front()->to_file_info(snapshots.front()->first_child(nodes.front()) + i));
+        return files;
+    }
+
+    if (nodes[0] == fs::snapshot::no_node && nodes[1] == fs::snapshot::no_node)
+        throw std::runtime_error("Directory not found in snapshots: " + target);
+    for (auto &change: fs::diff_snapshots(*snapshots[0], nodes[0], *snapshots[1], nodes[1])) {
+        if (change.delta < 0)
+            shrunk_names.insert(change.file.name);
+        change.file.length = std::abs(change.delta);
+        files.push_back(std::move(change.file));
+    }
+    return files;
+}
+
 void print_version() {
     std::cout << PROGRAM_NAME << " v" PROGRAM_VERSION ", built " __DATE__ " " __TIME__ "." << std::endl;
 }
@@ -105,6 +252,20 @@ template<typename T> constexpr T ce_pow(const T value, const int power) {
     return (power > 1) ? value * ce_pow(value, power - 1) : (power == 1) ? value : (power == 0) ? 0 : throw std::runtime_error("Power cannot be negative: " + std::to_string(power));
 }
 
+std::string format_length(const unsigned long length, const bool human_readable, const std::locale &locale) {
+    std::stringstream temp;
+    temp.imbue(locale);
+    if (human_readable && length >= ce_pow(1024ul, 3))
+        temp << length / ce_pow(1024, 3) << "G";
+    else if (human_readable && length >= ce_pow(1024ul, 2))
+        temp << length / ce_pow(1024, 2) << "M";
+    else if (human_readable && length >= 1024ul)
+        temp << length / 1024 << "K";
+    else
+        temp << length;
+    return temp.str();
+}
+
 int main(int argc, const char *argv[]) {
     // Parse arguments
     std::set<std::string> targets;
@@ -120,6 +281,21 @@ int main(int argc, const char *argv[]) {
     bool colorize {false};
     bool force_read_stdin {false};
     bool skip_next_arg {false};
+    fs::io_backend io_backend {fs::io_backend::sync};
+    bool count_links_once {false};
+    bool one_file_system {false};
+    bool all_file_systems {false};
+    bool stat_order_auto {true};
+    fs::stat_order stat_order {fs::stat_order::readdir};
+    bool stat_benchmark {false};
+    std::string cache_path {""};
+    bool watch_changes {false};
+    bool browse {false};
+    int tree_depth {0};
+    std::string export_path {""};
+    std::vector<std::string> import_paths {};
+    std::vector<std::string> missing_targets {};
+    watch::backend watch_backend {watch::backend::automatic};
 
     struct numpt_t : std::numpunct<char> {
         char tsep {'\0'};
@@ -145,9 +321,18 @@ int main(int argc, const char *argv[]) {
         else if (arg.key == "-") {
             force_read_stdin = true;
         }
+        else if (arg.key == "--all-fs") {
+            all_file_systems = true;
+        }
         else if (arg.key == "-0") {
             stdin_separator = '\0';
         }
+        else if (arg.key == "--browse") {
+            browse = true;
+        }
+        else if (arg.key == "--cache") {
+            cache_path = fs::absolute_path(arg.value);
+        }
         else if (arg.key == "-c" && arg.next) {
             count = std::stoi(arg.next->key); // TODO: sanity check
             skip_next_arg = true;
@@ -158,12 +343,30 @@ int main(int argc, const char *argv[]) {
         else if (arg.key == "-d") {
             enter_directory = false;
         }
+        else if (arg.key == "--depth" && arg.next) {
+            tree_depth = std::stoi(arg.next->key); // TODO: sanity check
+            skip_next_arg = true;
+        }
+        else if (arg.key == "--export") {
+            export_path = fs::absolute_path(arg.value);
+        }
         else if (arg.key == "-h") {
             human_readable = true;
         }
         else if (arg.key == "-i") {
             order_inverted = !order_inverted;
         }
+        else if (arg.key == "--io") {
+            if (arg.value == "sync")
+                io_backend = fs::io_backend::sync;
+            else if (arg.value == "uring")
+                io_backend = fs::io_backend::uring;
+            else
+                std::cerr << console::color::red << PROGRAM_NAME << ": Undefined I/O backend: \"" << arg.value << "\"" << console::color::reset << std::endl;
+        }
+        else if (arg.key == "--import") {
+            import_paths.push_back(fs::absolute_path(arg.value));
+        }
         else if (arg.key == "-j" && arg.next) {
             parse_threads = std::stoi(arg.next->key); // TODO: sanity check
             skip_next_arg = true;
@@ -175,10 +378,37 @@ int main(int argc, const char *argv[]) {
             order_by = std::string(arg.next->key);
             skip_next_arg = true;
         }
+        else if (arg.key == "--stat-order") {
+            stat_order_auto = arg.value == "auto";
+            if (arg.value == "readdir")
+                stat_order = fs::stat_order::readdir;
+            else if (arg.value == "inode")
+                stat_order = fs::stat_order::inode;
+            else if (!stat_order_auto)
+                std::cerr << console::color::red << PROGRAM_NAME << ": Undefined stat order: \"" << arg.value << "\"" << console::color::reset << std::endl;
+        }
+        else if (arg.key == "--stat-benchmark") {
+            stat_benchmark = true;
+        }
+        else if (arg.key == "-u") {
+            count_links_once = true;
+        }
         else if (arg.key == "-t" && arg.next) {
             timeout_ms = std::stoi(arg.next->key); // TODO: sanity check
             skip_next_arg = true;
         }
+        else if (arg.key == "--watch") {
+            watch_changes = true;
+            if (arg.value == "fanotify")
+                watch_backend = watch::backend::fanotify;
+            else if (arg.value == "inotify")
+                watch_backend = watch::backend::inotify;
+            else if (arg.value.length() > 0)
+                std::cerr << console::color::red << PROGRAM_NAME << ": Undefined watch backend: \"" << arg.value << "\"" << console::color::reset << std::endl;
+        }
+        else if (arg.key == "-x") {
+            one_file_system = true;
+        }
         else if (arg.key == "--tsep") {
             numpt.tsep = arg.value[0];
         }
@@ -187,7 +417,7 @@ int main(int argc, const char *argv[]) {
             if (fs::exists(potential_target))
                 targets.insert(std::move(potential_target));
             else
-                std::cerr << console::color::red << PROGRAM_NAME << ": Unhandled argument flag: \"" << arg.key << "\"" << console::color::reset << std::endl;
+                missing_targets.push_back(arg.key); // note: may be a directory of an imported snapshot
         }
         else {
             std::cerr << console::color::red << PROGRAM_NAME << ": Unhandled argument key: \"" << arg.key << "\", value: \"" << arg.value << "\"" << console::color::reset << std::endl;
@@ -197,8 +427,25 @@ int main(int argc, const char *argv[]) {
     // Set console properties
     console::color::enable = colorize;
 
+    if (import_paths.empty()) {
+        for (const auto &target: missing_targets)
+            std::cerr << console::color::red << PROGRAM_NAME << ": Unhandled argument flag: \"" << target << "\"" << console::color::reset << std::endl;
+    }
+
+#ifdef STATX_TYPE
+    if (io_backend == fs::io_backend::uring && !uring::supported()) {
+        std::cerr << console::color::red << PROGRAM_NAME << ": io_uring not supported by kernel, using synchronous I/O" << console::color::reset << std::endl;
+        io_backend = fs::io_backend::sync;
+    }
+#else
+    if (io_backend == fs::io_backend::uring) {
+        std::cerr << console::color::red << PROGRAM_NAME << ": io_uring requires statx(), using synchronous I/O" << console::color::reset << std::endl;
+        io_backend = fs::io_backend::sync;
+    }
+#endif
+
     // Read stdin as primary default target
-    if (targets.size() == 0 || force_read_stdin) {
+    if ((targets.size() == 0 && import_paths.empty()) || force_read_stdin) {
         for (auto const &target: pipes::read_stdin(stdin_separator, -1)) {
             if (target.length() > 0)
                 targets.insert(fs::absolute_path(target));
@@ -206,7 +453,7 @@ int main(int argc, const char *argv[]) {
     }
 
     // Use current working directory as secondary default target
-    if (targets.size() == 0) {
+    if (targets.size() == 0 && import_paths.empty()) {
         targets.insert(fs::current_working_directory());
     }
 
@@ -214,73 +461,41 @@ int main(int argc, const char *argv[]) {
 
     // Read file/directory contents asynchronously (and render loading progress indicator)
     enter_directory &= targets.size() == 1; // Only enter directory if it's the only target
-    threading::thread_pool tp(parse_threads);
-    std::vector<fs::file_info_t> result {};
-    std::mutex result_mutex {};
+    fs::raise_descriptor_limit();
 
-    // Callback declaration
-    std::function<void (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &, unsigned int, fs::file_info_t &, std::vector<fs::file_info_t>)> file_parse_callback = [&] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &yield, unsigned int depth, fs::file_info_t &parent, std::vector<fs::file_info_t> files) {
-        std::vector<std::shared_ptr<threading::task_t>> tasks {};
-        for (auto &file: files) {
-            if (file.type == fs::file_type::directory) {
-                auto task = tp.add([&file_parse_callback, depth, &file, enter_directory] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &y) { file_parse_callback(y, depth + 1, file, fs::read_directory(file.path + '/' + file.name, enter_directory, false)); });
-                if (task != nullptr)
-                    tasks.push_back(std::move(task));
-            }
-        }
+    // Only stat the fields needed by the sort order and the printout
+    unsigned int stat_fields { fs::file_field::field_type | fs::file_field::field_length };
+    if (order_by == "atime")
+        stat_fields |= fs::file_field::field_access_time;
+    else if (order_by == "mtime")
+        stat_fields |= fs::file_field::field_modify_time;
+    else if (order_by == "ctime")
+        stat_fields |= fs::file_field::field_change_time;
+    if (count_links_once)
+        stat_fields |= fs::file_field::field_links;
+    fs::link_accounting_t link_accounting {};
+    fs::link_accounting_t *accounting { count_links_once ? &link_accounting : nullptr };
 
-        // TODO: overload thread_pool.yield() to take list of tasks
-        for (const auto &task: tasks)
-            while(yield(task));
+    // Mount table is read once, mount points are then decided on by path while traversing
+    std::unique_ptr<fs::mount_policy> mount_policy {nullptr};
+    if (import_paths.empty() && (one_file_system || !all_file_systems))
+        mount_policy = std::make_unique<fs::mount_policy>(fs::read_mounts(), one_file_system, !all_file_systems);
+    const fs::mount_policy *policy { mount_policy.get() };
 
-        for (auto &file: files) {
-            parent.length += file.length;
+    if (stat_benchmark) {
+        benchmark_stat_order(targets, fs::read_options_t{stat_fields, io_backend, stat_order, policy});
+        return 0;
+    }
 
-            if (depth == 0)
-            {
-                std::lock_guard<std::mutex> result_lock(result_mutex);
-                result.push_back(file);
-            }
-        }
+    // Inode ordered stat pays off on rotational devices only, the device of a target is used for its whole tree
+    std::set<unsigned long> inode_ordered_devices {};
+    const auto get_stat_order = [&inode_ordered_devices, stat_order_auto, stat_order] (const unsigned long device) {
+        if (stat_order_auto)
+            return inode_ordered_devices.count(device) ? fs::stat_order::inode : fs::stat_order::readdir;
+        return stat_order;
     };
 
-    std::future<std::vector<fs::file_info_t>> future = std::async(std::launch::async, [&] {
-        std::vector<fs::file_info_t> parents {};
-        for (auto const &target: targets) {
-            parents.push_back(fs::read_file(target));
-        }
-
-        for (auto &parent: parents) {
-            if (parent.type == fs::file_type::directory) {
-                tp.add([&file_parse_callback, enter_directory, &parent] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &yield) { file_parse_callback(yield, enter_directory ? 0 : 1, parent, fs::read_directory(parent.path + '/' + parent.name, enter_directory, false)); });
-            }
-        }
-
-        tp.wait();
-
-        for (auto &parent: parents) {
-            if (!enter_directory)
-            {
-                std::lock_guard<std::mutex> result_lock(result_mutex);
-                result.push_back(parent);
-            }
-        }
-
-        return result;
-    });
-
-    // Wait for file system result
-    if (timeout_ms > 0) {
-        std::future_status status = future.wait_for(std::chrono::milliseconds(timeout_ms));
-        if (status != std::future_status::ready) {
-            std::cerr << console::color::red << PROGRAM_NAME << ": Timeout after " << timeout_ms << "ms" << console::color::reset << std::endl;
-            exit(3); // TODO: properly terminate std::future<>, we'd like to call 'return X' here.
-        }
-    }
-    else {
-        future.wait();
-    }
-    std::vector<fs::file_info_t> files { future.get() };
+    std::set<std::string> shrunk_names {}; // entries listed by their decrease, comparing snapshots
 
     // Sort contents
     // TODO: use keys in usage printout as available values of '-s'
@@ -298,22 +513,14 @@ int main(int argc, const char *argv[]) {
         std::cerr << console::color::red << PROGRAM_NAME << ": Undefined sort type: \"" << order_by << "\"" << console::color::reset << std::endl; // TODO: add valid ones to message
         return 2;
     }
-    std::sort(files.begin(), files.end(), [&] (const fs::file_info_t &a, const fs::file_info_t &b) { return comparators[order_by](a, b); });
-
-    // Find highest value (used for percentage)
-    unsigned long total_length {0};
-    for (const auto &file: files)
-        total_length += file.length;
-
-    // Strip exceeding items
-    if (count >= 0 && static_cast<unsigned int>(count) < files.size())
-        files.erase(files.begin() + count, files.end());
 
-    // Determine tty width
+    // Determine tty size
     int columns;
+    int lines;
     {
         console::tty temp;
         columns = temp.cols;
+        lines = temp.rows;
     }
 
     std::locale locale;
@@ -322,110 +529,680 @@ int main(int argc, const char *argv[]) {
     else
         locale = std::locale("C");
 
-    // Find out the maximum width for filenames, maximum size for files
-    unsigned int name_width {0};
-    unsigned int size_width {0};
-    for (auto const &file: files) {
-        if (file.type == fs::file_type::directory)
-            name_width = std::max(name_width, console::text_width(file.name) + 1); // Directories are suffixed with '/'
-        else
-            name_width = std::max(name_width, console::text_width(file.name));
-
-        std::stringstream temp;
-        temp.imbue(locale);
-        if (human_readable && file.length >= 1024) {
-            if (file.length >= ce_pow(1024ul, 3))
-                temp << file.length / ce_pow(1024, 3);
-            else if (file.length >= ce_pow(1024ul, 2))
-                temp << file.length / ce_pow(1024, 2);
-            else if (file.length >= 1024ul)
-                temp << file.length / 1024;
+    fs::node_tree tree {};
+
+    // Children of kept nodes, replaced by the watched children while watching
+    std::function<std::vector<fs::node_id> (fs::node_id)> children_of {nullptr};
+
+    // Lists the entries of a level, each followed by its own entries down to the tree depth
+    std::function<void (std::vector<tree_row_t>, std::vector<tree_row_t> &)> list_level = [&] (std::vector<tree_row_t> level, std::vector<tree_row_t> &listed) {
+        // Sort only the printed head, then strip exceeding items
+        const std::size_t head_count { count >= 0 ? static_cast<std::size_t>(count) : level.size() };
+        const auto &comparator = comparators[order_by];
+        sorting::sort_head(level.begin(), level.end(), head_count, [&comparator] (const tree_row_t &first, const tree_row_t &second) { return comparator(first.file, second.file); });
+        if (head_count < level.size())
+            level.erase(level.begin() + head_count, level.end());
+
+        for (auto &row: level) {
+            const fs::node_id node { row.node };
+            const unsigned int depth { row.depth };
+            const unsigned long length { row.file.length };
+            listed.push_back(std::move(row));
+            if (node == fs::no_node || static_cast<int>(depth) >= tree_depth || children_of == nullptr)
+                continue;
+            std::vector<tree_row_t> children {};
+            for (const fs::node_id child: children_of(node))
+                children.push_back(tree_row_t{tree.to_file_info(child), child, depth + 1, length});
+            list_level(std::move(children), listed);
         }
-        else
-            temp << file.length;
-        size_width = std::max(size_width, (unsigned int) temp.str().length());
-    }
+    };
 
-    const unsigned int max_name_width {35};
-    name_width = std::min(max_name_width, name_width);
-    if (human_readable)
-        size_width++;  // 1 for unit or space
-
-    // Dump result
-    const int chars_left = columns - (1 + name_width + 1 + size_width + 1);
-    for (auto const &file: files) {
-        std::string row_data {""};
-
-        // Prefix
-        if (file.error != fs::file_error::none)
-            row_data += console::color::red() + "!" + console::color::reset();
-        else if (file.type == fs::file_type::directory)
-            row_data += "*";
-        else
+    // Render the rows of the result, also used to re-render while watching
+    unsigned long total_length {0};
+    const auto render_rows = [&] (std::vector<fs::file_info_t> files, const std::vector<fs::node_id> &nodes) {
+        std::vector<std::string> rows {};
+
+        // Find highest value (used for percentage)
+        total_length = 0;
+        for (const auto &file: files)
+            total_length += file.length;
+
+        std::vector<tree_row_t> level {};
+        level.reserve(files.size());
+        for (std::size_t i = 0; i < files.size(); i++)
+            level.push_back(tree_row_t{std::move(files[i]), i < nodes.size() ? nodes[i] : fs::no_node, 0, total_length});
+        std::vector<tree_row_t> listed {};
+        list_level(std::move(level), listed);
+
+        // Find out the maximum width for filenames, maximum size for files
+        unsigned int name_width {0};
+        unsigned int size_width {0};
+        unsigned int indent_width {0};
+        for (auto const &row: listed) {
+            const fs::file_info_t &file = row.file;
+            indent_width = std::max(indent_width, 2 * row.depth);
+            if (file.type == fs::file_type::directory)
+                name_width = std::max(name_width, 2 * row.depth + console::text_width(file.name) + 1); // Directories are suffixed with '/'
+            else
+                name_width = std::max(name_width, 2 * row.depth + console::text_width(file.name));
+
+            std::stringstream temp;
+            temp.imbue(locale);
+            if (human_readable && file.length >= 1024) {
+                if (file.length >= ce_pow(1024ul, 3))
+                    temp << file.length / ce_pow(1024, 3);
+                else if (file.length >= ce_pow(1024ul, 2))
+                    temp << file.length / ce_pow(1024, 2);
+                else if (file.length >= 1024ul)
+                    temp << file.length / 1024;
+            }
+            else
+                temp << file.length;
+            size_width = std::max(size_width, (unsigned int) temp.str().length());
+        }
+
+        const unsigned int max_name_width {35};
+        name_width = std::min(max_name_width + indent_width, name_width);
+        if (human_readable)
+            size_width++;  // 1 for unit or space
+        if (import_paths.size() > 1)
+            size_width++;  // 1 for sign of the difference
+
+        // Dump result
+        const int chars_left = columns - (1 + name_width + 1 + size_width + 1);
+        for (auto const &row: listed) {
+            const fs::file_info_t &file = row.file;
+            std::string row_data(2 * row.depth, ' ');
+
+            // Prefix
+            if (file.error == fs::file_error::incomplete)
+                row_data += console::color::yellow() + ">" + console::color::reset();
+            else if (file.error != fs::file_error::none)
+                row_data += console::color::red() + "!" + console::color::reset();
+            else if (file.type == fs::file_type::directory)
+                row_data += "*";
+            else
+                row_data += " ";
+
+            // Filename
+            const unsigned int file_name_width { name_width - 2 * row.depth };
+            unsigned int file_name_length = console::text_width(file.name);
+            if (file_name_length > file_name_width)
+                row_data += file.name.substr(0, file_name_width - 2) + "..";
+            else if (file.type == fs::file_type::directory)
+                row_data += file.name + '/' + std::string(file_name_width - file_name_length - 1, ' ');
+            else
+                row_data += file.name + std::string(file_name_width - file_name_length, ' ');
             row_data += " ";
 
-        // Filename
-        unsigned int file_name_length = console::text_width(file.name);
-        if (file_name_length > name_width)
-            row_data += file.name.substr(0, name_width - 2) + "..";
-        else if (file.type == fs::file_type::directory)
-            row_data += file.name + '/' + std::string(name_width - file_name_length - 1, ' ');
-        else
-            row_data += file.name + std::string(name_width - file_name_length, ' ');
-        row_data += " ";
-
-        // File size
-        std::stringstream temp;
-        temp.imbue(locale);
-        if (human_readable) {
-            temp << std::setw(size_width - 1);  // only the number part
-            if (file.length >= ce_pow(1024ul, 3))
-                temp << file.length / ce_pow(1024, 3) << "G";
-            else if (file.length >= ce_pow(1024ul, 2))
-                temp << file.length / ce_pow(1024, 2) << "M";
-            else if (file.length >= 1024ul)
-                temp << file.length / 1024 << "K";
+            // File size
+            std::stringstream temp;
+            temp.imbue(locale);
+            if (human_readable) {
+                temp << std::setw(size_width - 1);  // only the number part
+                if (file.length >= ce_pow(1024ul, 3))
+                    temp << file.length / ce_pow(1024, 3) << "G";
+                else if (file.length >= ce_pow(1024ul, 2))
+                    temp << file.length / ce_pow(1024, 2) << "M";
+                else if (file.length >= 1024ul)
+                    temp << file.length / 1024 << "K";
+                else
+                    temp << file.length << " ";
+            }
+            else {
+                temp << std::setw(size_width) << file.length;
+            }
+            std::string size_text { temp.str() };
+            if (import_paths.size() > 1)
+                size_text[size_text.find_first_not_of(' ') - 1] = shrunk_names.count(file.name) ? '-' : '+'; // note: padded by the column reserved for the sign
+            row_data += size_text;
+            row_data += " ";
+
+            double factor = (row.parent_length > 0) ? (static_cast<double>(file.length) / static_cast<double>(row.parent_length)) : 0.0;
+#ifdef DEBUG
+            if (factor < 0.0 || factor > 1.0)
+                throw std::runtime_error("Factor must be between 0.0-1.0. File name: \"" + file.path + "/" + file.name + "\". File length: " + std::to_string(file.length) + ". Parent length: " + std::to_string(row.parent_length) + ". Calculated factor: " + std::to_string(factor) + ".");
+#endif
+            double percent = factor * 100.0;
+
+            // Progress bar
+            int progress_width = chars_left - 4 /* last 4 chars for "xxx%" */;
+            int bar_width = (progress_width - 3) * factor;
+            row_data += "[";
+            if (percent >= 50)
+                row_data += console::color::red();
+            else if (percent >= 25)
+                row_data += console::color::yellow();
             else
-                temp << file.length << " ";
+                row_data += console::color::green();
+            row_data += std::string(bar_width, '=');
+            row_data += "|";
+            row_data += console::color::reset();
+            row_data += std::string(progress_width - bar_width - 3, ' ');
+            row_data += "]";
+
+            // Percentage
+            if (static_cast<int>(percent) < 10)
+                row_data += "  ";
+            else if (static_cast<int>(percent) < 100)
+                row_data += " ";
+            row_data += std::to_string(static_cast<int>(percent)) + "%";
+
+            rows.push_back(std::move(row_data));
+        }
+
+        return rows;
+    };
+
+
+    std::unique_ptr<fs::scan_cache> scan_cache {nullptr};
+    if (cache_path.length() > 0)
+        scan_cache = std::make_unique<fs::scan_cache>(cache_path);
+
+    // Partial results are only rendered to terminals, they are redrawn in place
+    const bool progressive { isatty(STDOUT_FILENO) == 1 && import_paths.empty() };
+    const std::chrono::milliseconds progress_interval {250};
+    const bool track_progress { progressive || (timeout_ms > 0 && import_paths.empty()) }; // also listed if the scan does not stop after the deadline
+    scan_progress_t progress {};
+    fs::node_id progress_root {fs::no_node};
+    std::atomic_bool scan_cancelled {false}; // set once the deadline (-t) passed
+
+    threading::thread_pool tp(parse_threads);
+    std::vector<fs::file_info_t> result {};
+    std::vector<fs::node_id> result_nodes {}; // node of each result entry, expanded in tree mode
+    std::mutex result_mutex {};
+    std::vector<fs::node_id> roots {};
+
+    // Targets nested below other targets are not parsed on their own, their nodes are recorded while parsing the outer ones
+    std::vector<planning::target_plan_t> target_plan {};
+    std::vector<fs::node_id> target_nodes {};
+
+    // Entries deeper than printed are folded into the length of their directory, unless the full tree is used afterwards
+    const unsigned int fold_depth { watch_changes || browse || export_path.length() > 0 ? ~0u : static_cast<unsigned int>(std::max(tree_depth, 0)) };
+
+    // Continuation of a directory, executed by the thread completing the last task of its subdirectories
+    const std::function<void (directory_job_t &)> aggregate_directory = [&] (directory_job_t &job) {
+        subtree_t &subtree = *job.subtree;
+        unsigned long length {0};
+        for (auto &entry: job.entries) {
+            entry.file.length += entry.subtree.length;
+            if (entry.file.error == fs::file_error::none || entry.subtree.error == fs::file_error::incomplete)
+                entry.file.error = entry.subtree.error;
+            fs::propagate_error(subtree.error, entry.file.error);
+            if (job.fold) {
+                length += entry.file.length;
+                continue;
+            }
+            job.arena->set_stat(entry.node, entry.file);
+            job.arena->set_children(entry.node, entry.subtree.first_child, entry.subtree.child_count);
+        }
+        if (!job.fold && !job.entries.empty()) {
+            subtree.first_child = job.entries.front().node;
+            subtree.child_count = job.entries.size();
+            length = job.arena->sum_lengths(subtree.first_child, subtree.child_count);
+        }
+        subtree.length += length;
+
+        if (job.listed && scan_cache != nullptr) {
+            std::vector<fs::dirent_t> listing {};
+            listing.reserve(job.entries.size());
+            for (const auto &entry: job.entries)
+                listing.push_back(fs::dirent_t{entry.file.inode, entry.file.type, entry.name});
+            scan_cache->record(job.stamp, listing);
+        }
+        if (job.completed)
+            job.completed();
+    };
+
+    /*
+        Callback declaration, 'depth' is the printed level of the directory's
+        entries. The directory is listed and stat'ed and its subdirectories
+        dispatched, none of them is waited for: the entries are aggregated by
+        the continuation of the directory's task group once the last of them
+        completed, which in turn completes the parent's group.
+    */
+    std::function<void (const std::shared_ptr<fs::directory> &, fs::node_id, subtree_t &, const planning::target_plan_t *, unsigned int, threading::task_group *, std::function<void ()>)> file_parse_callback = [&] (const std::shared_ptr<fs::directory> &directory, fs::node_id directory_node, subtree_t &subtree, const planning::target_plan_t *plan, unsigned int depth, threading::task_group *parent_group, std::function<void ()> completed) {
+        if (plan != nullptr) {
+            for (const std::size_t target: plan->targets)
+                target_nodes[target] = directory_node;
+        }
+        directory_job_t *job { new directory_job_t(aggregate_directory, parent_group) }; // note: deletes itself, see directory_job_t
+        job->directory = directory;
+        job->node = directory_node;
+        job->subtree = &subtree;
+        job->arena = &tree.local_arena(); // note: appended by this task only, the continuation updates nodes appended already
+        job->fold = depth > fold_depth && plan == nullptr; // note: directories leading to nested targets are kept
+        job->completed = std::move(completed);
+        fs::node_arena &arena = *job->arena;
+        std::deque<parse_entry_t> &entries = job->entries;
+
+        // Closes the group when returning, aggregated right away if all subdirectories completed already
+        struct group_closer_t {
+            threading::thread_pool &pool;
+            directory_job_t &job;
+            const int exceptions { std::uncaught_exceptions() };
+            ~group_closer_t() {
+                if (std::uncaught_exceptions() > exceptions)
+                    job.subtree->error = fs::file_error::incomplete; // note: the parent is still completed, the entries listed so far are kept
+                pool.close_group(job.group);
+            }
+        } group_closer {tp, *job};
+        const bool top_level { track_progress && directory_node != fs::no_node && directory_node == progress_root };
+
+        const auto subdirectory_task = [&file_parse_callback, job, policy, &progress, depth, top_level] (parse_entry_t &entry, const planning::target_plan_t *child_plan) {
+            return [&file_parse_callback, &entry, job, policy, &progress, child_plan, depth, top_level] {
+                const auto not_entered = [&progress, &entry, top_level] {
+                    if (top_level) {
+                        std::lock_guard<std::mutex> progress_lock(progress.mutex);
+                        progress.pending.erase(entry.node);
+                    }
+                };
+                entry.subtree.error = fs::file_error::none;
+                std::shared_ptr<fs::directory> child = fs::open_directory(*job->directory, entry.name);
+                if (child == nullptr) {
+                    entry.subtree.error = fs::to_file_error(errno);
+                    not_entered();
+                    return;
+                }
+                if (policy != nullptr && !policy->may_enter(*child)) {
+                    not_entered();
+                    return;
+                }
+                std::function<void ()> child_completed {};
+                if (top_level) {
+                    child_completed = [&progress, &entry] {
+                        std::lock_guard<std::mutex> progress_lock(progress.mutex);
+                        progress.pending.erase(entry.node);
+                        fs::file_info_t &fi = progress.entries[entry.node];
+                        fi.type = fs::file_type::directory;
+                        fi.name = entry.name;
+                        fi.length += entry.subtree.length;
+                    };
+                }
+                file_parse_callback(child, entry.node, entry.subtree, child_plan, depth + 1, &job->group, std::move(child_completed));
+            };
+        };
+
+        // Sibling directories are queued in batches, at once after listing and after stat'ing
+        std::vector<decltype(subdirectory_task(std::declval<parse_entry_t &>(), nullptr))> batch {};
+        const auto dispatch = [&] (parse_entry_t &entry) {
+            entry.dispatched = true;
+            if (policy != nullptr && !policy->may_enter(*directory, entry.name))
+                return; // Excluded mount point, only accounted by its own size
+
+            const planning::target_plan_t *child_plan {nullptr};
+            if (plan != nullptr) {
+                const auto found = plan->children.find(std::string_view(entry.name));
+                if (found != plan->children.end())
+                    child_plan = &target_plan[found->second];
+            }
+
+            entry.subtree.error = fs::file_error::incomplete; // kept if the task is aborted
+            if (top_level) {
+                std::lock_guard<std::mutex> progress_lock(progress.mutex);
+                progress.pending.insert(entry.node);
+            }
+            batch.push_back(subdirectory_task(entry, child_plan));
+        };
+        const auto spawn_batch = [&] {
+            tp.spawn(batch.begin(), batch.end(), &job->group);
+            batch.clear();
+        };
+
+        // Directories known by d_type are dispatched once listed, their subtrees are parsed while this directory is stat'ed
+        const auto list_entry = [&] (const fs::dirent_t &dirent) {
+            const fs::node_id node { job->fold ? fs::no_node : arena.append(directory_node, dirent.name, dirent.type) };
+            entries.push_back(parse_entry_t{fs::file_stat_t{}, job->fold ? job->folded_names.intern(dirent.name) : arena.name(node), node, subtree_t{0, fs::file_error::none, fs::no_node, 0}, false});
+            parse_entry_t &entry = entries.back();
+            entry.file.inode = dirent.inode;
+            if (dirent.type == fs::file_type::directory)
+                dispatch(entry);
+        };
+        job->listed = scan_cache != nullptr ? scan_cache->read_entries(*directory, job->stamp, list_entry) : fs::read_entries(*directory, list_entry);
+        spawn_batch();
+
+        if (!entries.empty()) {
+            std::vector<fs::file_stat_t *> files {};
+            std::vector<const char *> names {};
+            files.reserve(entries.size());
+            names.reserve(entries.size());
+            for (auto &entry: entries) {
+                files.push_back(&entry.file);
+                names.push_back(entry.name);
+            }
+            fs::stat_files(*directory, files, names, stat_fields, io_backend, get_stat_order(directory->root_device));
+            if (accounting != nullptr)
+                fs::charge_once(files, *accounting);
+
+            if (track_progress) {
+                unsigned long stat_length {0};
+                for (const auto &entry: entries)
+                    stat_length += entry.file.length;
+                progress.entry_count += entries.size();
+                progress.length += stat_length;
+                if (top_level) {
+                    // note: the subtree of a directory may be complete already, its length is kept
+                    std::lock_guard<std::mutex> progress_lock(progress.mutex);
+                    for (const auto &entry: entries) {
+                        fs::file_info_t &fi = progress.entries[entry.node];
+                        const unsigned long subtree_length { fi.length };
+                        static_cast<fs::file_stat_t &>(fi) = entry.file;
+                        fi.name = entry.name;
+                        fi.length += subtree_length;
+                    }
+                }
+            }
+
+            for (auto &entry: entries) {
+                if (!entry.dispatched && entry.file.type == fs::file_type::directory)
+                    dispatch(entry); // d_type not supported by file system
+            }
+            spawn_batch();
+        }
+    };
+
+    std::future<std::vector<fs::file_info_t>> future = std::async(std::launch::async, [&] {
+        if (import_paths.size() > 0) {
+            std::string snapshot_target {""};
+            if (targets.size() > 0)
+                snapshot_target = *targets.begin();
+            else if (missing_targets.size() > 0)
+                snapshot_target = fs::absolute_path(missing_targets.front());
+            return read_snapshots(import_paths, snapshot_target, shrunk_names);
+        }
+
+        std::vector<fs::file_info_t> parents {};
+        for (auto const &target: targets) {
+            if (scan_cancelled.load()) {
+                fs::file_info_t fi {};
+                fi.path = fs::dirname(target);
+                fi.name = fs::basename(target);
+                fi.error = fs::file_error::incomplete;
+                parents.push_back(std::move(fi));
+                continue;
+            }
+            parents.push_back(fs::read_file(target, stat_fields));
+            if (stat_order_auto && parents.back().error == fs::file_error::none && fs::is_rotational(parents.back().device))
+                inode_ordered_devices.insert(parents.back().device);
+        }
+
+        // Targets are parsed alike whether entered or not, only the printed level differs
+        roots.assign(parents.size(), fs::no_node);
+        target_nodes.assign(parents.size(), fs::no_node);
+        std::vector<subtree_t> root_subtrees(parents.size(), subtree_t{0, fs::file_error::none, fs::no_node, 0});
+        std::vector<std::string> root_paths(parents.size());
+        std::vector<std::size_t> plan_nodes(parents.size(), 0);
+        for (std::size_t i = 0; i < parents.size(); i++) {
+            if (parents[i].type == fs::file_type::directory) {
+                root_paths[i] = fs::real_path(parents[i].path + '/' + parents[i].name); // note: canonical for mount point and plan lookups
+                plan_nodes[i] = planning::add_plan_target(target_plan, root_paths[i], i);
+            }
+        }
+
+        /*
+            Each directory is parsed once, the outermost targets are parsed
+            and the nested ones resolved by their recorded nodes. Targets not
+            reached by the outer ones (excluded mount points, unreadable
+            directories) are parsed in the following round.
+        */
+        std::vector<bool> resolved(parents.size(), false);
+        std::vector<std::size_t> pending {};
+        if (!target_plan.empty())
+            planning::collect_plan_roots(target_plan, 0, resolved, pending);
+        while (!pending.empty()) {
+            for (const std::size_t i: pending) {
+                fs::file_info_t &parent = parents[i];
+                resolved[i] = true;
+                roots[i] = tree.local_arena().append(fs::no_node, root_paths[i], parent.type);
+                if (enter_directory)
+                    progress_root = roots[i];
+                else if (accounting != nullptr)
+                    accounting->apparent_length += parent.length;
+                root_subtrees[i].error = fs::file_error::incomplete; // note: kept if the task is aborted
+                if (track_progress && !enter_directory) {
+                    std::lock_guard<std::mutex> progress_lock(progress.mutex);
+                    progress.entries[i] = parents[i];
+                    progress.entries[i].error = fs::file_error::incomplete; // replaced once aggregated
+                }
+                tp.add([&file_parse_callback, &progress, track_progress, enter_directory, &parent, i, &path = root_paths[i], plan = &target_plan[plan_nodes[i]], root = roots[i], &root_subtree = root_subtrees[i]] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &) {
+                    root_subtree.error = fs::file_error::none;
+                    std::shared_ptr<fs::directory> directory = fs::open_directory(path);
+                    if (directory == nullptr) {
+                        parent.error = fs::to_file_error(errno);
+                        return;
+                    }
+                    std::function<void ()> completed {};
+                    if (track_progress && !enter_directory) {
+                        completed = [&progress, &parent, i, &root_subtree] {
+                            std::lock_guard<std::mutex> progress_lock(progress.mutex);
+                            fs::file_info_t &fi = progress.entries[i];
+                            fi = parent;
+                            fi.length += root_subtree.length;
+                            fs::propagate_error(fi.error, root_subtree.error);
+                        };
+                    }
+                    file_parse_callback(directory, root, root_subtree, plan, enter_directory ? 0 : 1, nullptr, std::move(completed));
+                });
+            }
+
+            tp.wait();
+
+            for (const std::size_t i: pending) {
+                fs::node_arena &arena = tree.arena(roots[i]);
+                parents[i].length += root_subtrees[i].length;
+                fs::propagate_error(parents[i].error, root_subtrees[i].error);
+                arena.set_stat(roots[i], parents[i]);
+                arena.set_children(roots[i], root_subtrees[i].first_child, root_subtrees[i].child_count);
+            }
+            for (std::size_t i = 0; i < parents.size(); i++) {
+                if (target_nodes[i] != fs::no_node)
+                    resolved[i] = true;
+            }
+            pending.clear();
+            planning::collect_plan_roots(target_plan, 0, resolved, pending);
+        }
+
+        for (std::size_t i = 0; i < parents.size(); i++) {
+            if (roots[i] == fs::no_node && target_nodes[i] != fs::no_node) {
+                // Nested target, aggregated by the parse of the outer one
+                const fs::node_arena &arena = tree.arena(target_nodes[i]);
+                parents[i].length = arena.length(target_nodes[i]);
+                parents[i].error = arena.error(target_nodes[i]);
+            }
+
+            std::lock_guard<std::mutex> result_lock(result_mutex);
+            if (!enter_directory) {
+                result.push_back(parents[i]);
+                result_nodes.push_back(roots[i] != fs::no_node ? roots[i] : target_nodes[i]);
+            }
+            else if (roots[i] != fs::no_node) {
+                for (const fs::node_id child: tree.children(roots[i])) {
+                    result.push_back(tree.to_file_info(child)); // note: full paths rebuilt for the printed entries only
+                    result_nodes.push_back(child);
+                }
+            }
+        }
+
+        return result;
+    });
+
+    // Wait for file system result, rendering the partial result in between
+    const auto scan_start = std::chrono::steady_clock::now();
+    auto deadline = scan_start + std::chrono::milliseconds(timeout_ms);
+    const std::chrono::milliseconds stop_grace {1000}; // for the directories being read when the deadline passes
+    std::vector<std::string> progress_rows {};
+    while (true) {
+        if (!progressive && timeout_ms <= 0) {
+            future.wait();
+            break;
+        }
+        auto wait_until = progressive ? std::chrono::steady_clock::now() + progress_interval : deadline;
+        if (timeout_ms > 0)
+            wait_until = std::min(wait_until, deadline);
+        if (future.wait_until(wait_until) == std::future_status::ready)
+            break;
+        if (timeout_ms > 0 && std::chrono::steady_clock::now() >= deadline) {
+            if (scan_cancelled.load()) {
+                // e.g. blocked by an unresponsive network file system, the top-level rows stat'ed so far are listed
+                std::vector<fs::file_info_t> files {};
+                {
+                    std::lock_guard<std::mutex> progress_lock(progress.mutex);
+                    for (const auto &entry: progress.entries) {
+                        files.push_back(entry.second);
+                        if (progress.pending.count(entry.first) > 0)
+                            files.back().error = fs::file_error::incomplete;
+                    }
+                }
+                std::vector<std::string> rows { render_rows(files, {}) };
+                if (progress_rows.size() > 0) {
+                    console::update_rows(std::cout, progress_rows, rows);
+                }
+                else {
+                    for (const auto &row: rows)
+                        std::cout << row << std::endl;
+                }
+                std::cout.flush();
+                std::cerr << console::color::yellow << PROGRAM_NAME << ": Timeout after " << timeout_ms << "ms, scan did not stop within " << stop_grace.count() << "ms, sizes of incomplete entries (>) are lower bounds" << console::color::reset << std::endl;
+                _exit(3); // note: the blocked threads can not be joined
+            }
+            // Workers complete the directories being read and stop descending, the sizes aggregated so far are listed
+            scan_cancelled.store(true);
+            tp.abort_tasks();
+            deadline = std::chrono::steady_clock::now() + stop_grace;
+            if (!progressive)
+                continue;
+        }
+
+        std::vector<fs::file_info_t> files {};
+        {
+            std::lock_guard<std::mutex> progress_lock(progress.mutex);
+            for (const auto &entry: progress.entries)
+                files.push_back(entry.second);
+        }
+        const std::size_t fitting_rows { static_cast<std::size_t>(std::max(lines - 2, 0)) }; // above the status line
+        if (files.size() > fitting_rows) {
+            // Rows scrolled off the screen can not be redrawn, also if -c exceeds the screen
+            sorting::sort_head(files.begin(), files.end(), fitting_rows, comparators[order_by]);
+            files.erase(files.begin() + fitting_rows, files.end());
+        }
+        std::vector<std::string> rows { render_rows(files, {}) }; // note: lengths below the top level are not final yet
+        const std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - scan_start;
+        const unsigned long entry_count { progress.entry_count.load() };
+        rows.push_back("Scanning: " + format_length(progress.length.load(), human_readable, locale) + " in " + std::to_string(entry_count) + " entries, " + std::to_string(static_cast<unsigned long>(entry_count / elapsed_time.count())) + " entries/s");
+        console::update_rows(std::cout, progress_rows, rows);
+        progress_rows = std::move(rows);
+    }
+    std::vector<fs::file_info_t> scanned_files {};
+    try {
+        scanned_files = future.get();
+    }
+    catch (const std::runtime_error &e) {
+        std::cerr << console::color::red << PROGRAM_NAME << ": " << e.what() << console::color::reset << std::endl;
+        return 1;
+    }
+
+    if (export_path.length() > 0) {
+        if (!enter_directory || roots.size() != 1 || roots.front() == fs::no_node) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": Exporting requires a single directory to be entered" << console::color::reset << std::endl;
         }
         else {
-            temp << std::setw(size_width) << file.length;
+            try {
+                fs::snapshot::write(export_path, tree, roots);
+            }
+            catch (const std::runtime_error &e) {
+                std::cerr << console::color::red << PROGRAM_NAME << ": " << e.what() << console::color::reset << std::endl;
+            }
         }
-        row_data += temp.str();
-        row_data += " ";
+    }
 
-        double factor = (total_length > 0) ? (static_cast<double>(file.length) / static_cast<double>(total_length)) : 0.0;
+    if (scan_cache != nullptr) {
+        try {
+            scan_cache->save();
+        }
+        catch (const std::runtime_error &e) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": " << e.what() << console::color::reset << std::endl;
+        }
 #ifdef DEBUG
-        if (factor < 0.0 || factor > 1.0)
-            throw std::runtime_error("Factor must be between 0.0-1.0. File name: \"" + file.path + "/" + file.name + "\". File length: " + std::to_string(file.length) + ". Total length: " + std::to_string(total_length) + ". Calculated factor: " + std::to_string(factor) + ".");
+        std::cout << "scan cache hits: " << scan_cache->hits.load() << ", misses: " << scan_cache->misses.load() << std::endl;
 #endif
-        double percent = factor * 100.0;
-
-        // Progress bar
-        int progress_width = chars_left - 4 /* last 4 chars for "xxx%" */;
-        int bar_width = (progress_width - 3) * factor;
-        row_data += "[";
-        if (percent >= 50)
-            row_data += console::color::red();
-        else if (percent >= 25)
-            row_data += console::color::yellow();
-        else
-            row_data += console::color::green();
-        row_data += std::string(bar_width, '=');
-        row_data += "|";
-        row_data += console::color::reset();
-        row_data += std::string(progress_width - bar_width - 3, ' ');
-        row_data += "]";
-
-        // Percentage
-        if (static_cast<int>(percent) < 10)
-            row_data += "  ";
-        else if (static_cast<int>(percent) < 100)
-            row_data += " ";
-        row_data += std::to_string(static_cast<int>(percent)) + "%";
+    }
+
+    if (browse) {
+        if (!enter_directory || roots.size() != 1 || roots.front() == fs::no_node) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": Browsing requires a single directory to be entered" << console::color::reset << std::endl;
+            return 1;
+        }
+        try {
+            console::tty terminal;
+            terminal.start();
+            browser::tree_browser tree_browser(tree, roots.front(), terminal, stat_fields, policy, [human_readable, &locale] (const unsigned long length) { return format_length(length, human_readable, locale); });
+            tree_browser.set_order(order_by == "name" ? browser::sort_key::name : order_by == "mtime" ? browser::sort_key::modify_time : browser::sort_key::size, order_inverted);
+            tree_browser.run();
+        }
+        catch (const std::runtime_error &e) {
+            std::cerr << console::color::red << PROGRAM_NAME << ": " << e.what() << console::color::reset << std::endl;
+            return 1;
+        }
+        return scan_cancelled.load() ? 3 : 0;
+    }
+
+    children_of = [&tree] (const fs::node_id node) { return tree.children(node); };
+    std::vector<std::string> rows { render_rows(scanned_files, result_nodes) };
+    // Summary of -u, nested targets are counted by their outer target as their apparent length is
+    const auto links_summary = [&] (const unsigned long length) {
+        return "Total: " + format_length(length, human_readable, locale) + ", apparent (all hard links): " + format_length(link_accounting.apparent_length.load(), human_readable, locale);
+    };
+    if (count_links_once && import_paths.empty())
+        rows.push_back(links_summary(enter_directory ? total_length : planning::root_length(scanned_files, roots)));
+    if (progress_rows.size() > 0) {
+        console::update_rows(std::cout, progress_rows, rows);
+    }
+    else {
+        for (const auto &row: rows)
+            std::cout << row << std::endl;
+    }
+
+    if (scan_cancelled.load())
+        std::cerr << console::color::yellow << PROGRAM_NAME << ": Timeout after " << timeout_ms << "ms, sizes of incomplete entries (>) are lower bounds" << console::color::reset << std::endl;
+
+    if (!watch_changes)
+        return scan_cancelled.load() ? 3 : 0;
+    if (!enter_directory || roots.size() != 1 || roots.front() == fs::no_node) {
+        std::cerr << console::color::red << PROGRAM_NAME << ": Watching requires a single directory to be entered" << console::color::reset << std::endl;
+        return 1;
+    }
 
-        std::cout << row_data << std::endl;
+    // Keep the listing current, only the ancestors of changed entries are updated and only changed rows are redrawn
+    // note: hard links are not deduplicated for entries changed while watching
+    std::unique_ptr<watch::tree_watcher> watcher {nullptr};
+    try {
+        watcher = std::make_unique<watch::tree_watcher>(tree, roots.front(), stat_fields, policy, watch_backend);
+    }
+    catch (const std::runtime_error &e) {
+        std::cerr << console::color::red << PROGRAM_NAME << ": " << e.what() << console::color::reset << std::endl;
+        return 1;
+    }
+    if (watcher->unwatched_directories() > 0) {
+        const std::string hint { watcher->get_backend() == watch::backend::inotify ? "see /proc/sys/fs/inotify/max_user_watches" : "file system not permitted or not supported by fanotify, try --watch=inotify" };
+        std::cerr << console::color::yellow << PROGRAM_NAME << ": " << watcher->unwatched_directories() << " directories are not watched (" << hint << ")" << console::color::reset << std::endl;
     }
+    children_of = [&watcher] (const fs::node_id node) { return watcher->children(node); };
 
-    return 0;
+    while (true) {
+        if (!watcher->update(-1))
+            continue;
+        // Coalesce bursts of changes into a single redraw
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        watcher->update(0);
+
+        std::vector<fs::file_info_t> files {};
+        const std::vector<fs::node_id> nodes { watcher->children(roots.front()) };
+        for (const fs::node_id child: nodes)
+            files.push_back(tree.to_file_info(child));
+        std::vector<std::string> new_rows { render_rows(files, nodes) };
+        if (count_links_once)
+            new_rows.push_back(links_summary(total_length));
+        console::update_rows(std::cout, rows, new_rows);
+        rows = std::move(new_rows);
+    }
 }
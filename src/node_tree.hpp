@@ -0,0 +1,327 @@
+#ifndef __NODE_TREE_HPP_INCLUDED__
+#define __NODE_TREE_HPP_INCLUDED__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+
+#include <string.h> // memcpy()
+
+#include "fs.hpp"
+
+namespace fs {
+    // Node reference: index of the arena in the upper 16 bits, index within the arena in the lower 48 bits
+    typedef unsigned long node_id;
+    constexpr fs::node_id no_node {~0ul};
+    constexpr unsigned int node_arena_shift {48};
+    constexpr fs::node_id node_index_mask {(1ul << node_arena_shift) - 1};
+
+    // NUL-terminated names interned in character blocks, which never move once allocated
+    class name_blocks {
+        private:
+            const std::size_t block_size;
+            std::vector<std::unique_ptr<char[]>> blocks {};
+            std::size_t block_used;
+
+        public:
+            name_blocks(const std::size_t block_size_) : block_size(block_size_), block_used(block_size_) {}
+            name_blocks(const name_blocks &) = delete;
+            name_blocks &operator=(const name_blocks &) = delete;
+
+            const char *intern(const std::string_view &name) {
+                if (block_used + name.length() + 1 > block_size) {
+                    blocks.emplace_back(new char[std::max(block_size, name.length() + 1)]);
+                    block_used = 0;
+                }
+                char *result { blocks.back().get() + block_used };
+                memcpy(result, name.data(), name.length());
+                result[name.length()] = '\0';
+                block_used += name.length() + 1;
+                return result;
+            }
+    };
+
+    /*
+        Append-only node storage written by a single thread. The metadata is
+        kept struct-of-arrays in fixed size chunks and the names are interned
+        NUL-terminated in character blocks. Neither chunks nor blocks move once
+        allocated, hence names stay valid while further nodes are appended.
+        Chunks are looked up in fixed segments of chunk pointers rather than a
+        growing vector, nodes already appended may thus be updated by other
+        threads while the owner appends.
+    */
+    class node_arena {
+        public:
+            static constexpr unsigned int chunk_bits {12};
+            static constexpr std::size_t chunk_size {1ul << chunk_bits};
+            static constexpr unsigned int segment_bits {10};
+            static constexpr std::size_t segment_size {1ul << segment_bits};
+            static constexpr std::size_t block_size {64 * 1024};
+
+        private:
+            struct chunk_t {
+                unsigned long lengths[chunk_size];
+                unsigned int access_times[chunk_size];
+                unsigned int modify_times[chunk_size];
+                unsigned int change_times[chunk_size];
+                fs::file_type types[chunk_size];
+                fs::file_error errors[chunk_size];
+                fs::node_id parents[chunk_size];
+                fs::node_id first_children[chunk_size];
+                unsigned int child_counts[chunk_size];
+                const char *names[chunk_size];
+            };
+
+            const fs::node_id arena_bits;
+            std::unique_ptr<std::unique_ptr<chunk_t>[]> segments[segment_size] {};
+            fs::name_blocks interned_names {block_size};
+            std::size_t count {0};
+
+            chunk_t *chunk(const std::size_t index) const {
+                const std::size_t chunk_index { index >> chunk_bits };
+                return segments[chunk_index >> segment_bits][chunk_index & (segment_size - 1)].get();
+            }
+
+            template<auto field> auto &get(const fs::node_id node) {
+                const std::size_t index { node & fs::node_index_mask };
+                return (chunk(index)->*field)[index & (chunk_size - 1)];
+            }
+
+            template<auto field> const auto &get(const fs::node_id node) const {
+                const std::size_t index { node & fs::node_index_mask };
+                return (chunk(index)->*field)[index & (chunk_size - 1)];
+            }
+
+        public:
+            node_arena(const unsigned long arena_index) : arena_bits(arena_index << fs::node_arena_shift) {}
+            node_arena(const node_arena &) = delete;
+            node_arena &operator=(const node_arena &) = delete;
+
+            fs::node_id append(const fs::node_id parent, const std::string_view &name, const fs::file_type type) {
+                if ((count & (chunk_size - 1)) == 0) {
+                    const std::size_t chunk_index { count >> chunk_bits };
+                    if (chunk_index >= segment_size * segment_size)
+                        throw std::runtime_error("Too many nodes in arena");
+                    std::unique_ptr<std::unique_ptr<chunk_t>[]> &segment { segments[chunk_index >> segment_bits] };
+                    if (segment == nullptr)
+                        segment.reset(new std::unique_ptr<chunk_t>[segment_size]);
+                    segment[chunk_index & (segment_size - 1)].reset(new chunk_t);
+                }
+                const fs::node_id node { arena_bits | count++ };
+                get<&chunk_t::lengths>(node) = 0;
+                get<&chunk_t::access_times>(node) = 0;
+                get<&chunk_t::modify_times>(node) = 0;
+                get<&chunk_t::change_times>(node) = 0;
+                get<&chunk_t::types>(node) = type;
+                get<&chunk_t::errors>(node) = fs::file_error::none;
+                get<&chunk_t::parents>(node) = parent;
+                get<&chunk_t::first_children>(node) = fs::no_node;
+                get<&chunk_t::child_counts>(node) = 0;
+                get<&chunk_t::names>(node) = interned_names.intern(name);
+                return node;
+            }
+
+            // Stores the metadata of the stat result, the fields not kept by nodes (mode, owner, ...) are dropped
+            void set_stat(const fs::node_id node, const fs::file_stat_t &fi) {
+                get<&chunk_t::lengths>(node) = fi.length;
+                get<&chunk_t::access_times>(node) = fi.access_time;
+                get<&chunk_t::modify_times>(node) = fi.modify_time;
+                get<&chunk_t::change_times>(node) = fi.change_time;
+                get<&chunk_t::types>(node) = fi.type;
+                get<&chunk_t::errors>(node) = fi.error;
+            }
+
+            // Children of a node are appended to a single arena in one go, hence are a contiguous range
+            void set_children(const fs::node_id node, const fs::node_id first_child, const unsigned int child_count) {
+                get<&chunk_t::first_children>(node) = first_child;
+                get<&chunk_t::child_counts>(node) = child_count;
+            }
+
+            std::size_t size() const { return count; }
+            fs::node_id node(const std::size_t index) const { return arena_bits | index; }
+
+            unsigned long &length(const fs::node_id node) { return get<&chunk_t::lengths>(node); }
+            unsigned long length(const fs::node_id node) const { return get<&chunk_t::lengths>(node); }
+            unsigned int access_time(const fs::node_id node) const { return get<&chunk_t::access_times>(node); }
+            unsigned int modify_time(const fs::node_id node) const { return get<&chunk_t::modify_times>(node); }
+            unsigned int change_time(const fs::node_id node) const { return get<&chunk_t::change_times>(node); }
+            fs::file_type type(const fs::node_id node) const { return get<&chunk_t::types>(node); }
+            fs::file_error &error(const fs::node_id node) { return get<&chunk_t::errors>(node); }
+            fs::file_error error(const fs::node_id node) const { return get<&chunk_t::errors>(node); }
+            fs::node_id parent(const fs::node_id node) const { return get<&chunk_t::parents>(node); }
+            fs::node_id first_child(const fs::node_id node) const { return get<&chunk_t::first_children>(node); }
+            unsigned int child_count(const fs::node_id node) const { return get<&chunk_t::child_counts>(node); }
+            const char *name(const fs::node_id node) const { return get<&chunk_t::names>(node); }
+
+            // Sum of the lengths of 'node_count' consecutive nodes, plain loops over the length arrays
+            unsigned long sum_lengths(const fs::node_id first, const std::size_t node_count) const {
+                unsigned long result {0};
+                std::size_t index { first & fs::node_index_mask };
+                std::size_t remaining { node_count };
+                while (remaining > 0) {
+                    const std::size_t offset { index & (chunk_size - 1) };
+                    const std::size_t length_count { std::min(remaining, chunk_size - offset) };
+                    const unsigned long *lengths { chunk(index)->lengths + offset };
+                    for (std::size_t i = 0; i < length_count; i++)
+                        result += lengths[i];
+                    index += length_count;
+                    remaining -= length_count;
+                }
+                return result;
+            }
+    };
+
+    /*
+        File tree of a scan. Every thread appends the nodes it creates to an
+        arena of its own, hence no locking is needed while scanning. Nodes are
+        referenced by fs::node_id, full paths are only rebuilt on demand. The
+        arena of a node may only be read by other threads once the scan is done
+        (e.g. after threading::thread_pool::wait()).
+    */
+    class node_tree {
+        private:
+            inline static std::atomic_ulong next_serial {1};
+            const unsigned long serial { next_serial.fetch_add(1) };
+
+            std::mutex arenas_mutex {};
+            std::vector<std::unique_ptr<fs::node_arena>> arenas {};
+
+        public:
+            node_tree() = default;
+            node_tree(const node_tree &) = delete;
+            node_tree &operator=(const node_tree &) = delete;
+
+            // Arena of the calling thread, created on first use
+            fs::node_arena &local_arena() {
+                struct local_t {
+                    unsigned long serial;
+                    fs::node_arena *arena;
+                };
+                thread_local std::vector<local_t> locals {};
+                for (const auto &local: locals) {
+                    if (local.serial == serial)
+                        return *local.arena;
+                }
+
+                std::lock_guard<std::mutex> arenas_lock(arenas_mutex);
+                if (arenas.size() >= (fs::no_node >> fs::node_arena_shift))
+                    throw std::runtime_error("Too many node arenas: " + std::to_string(arenas.size()));
+                arenas.push_back(std::make_unique<fs::node_arena>(arenas.size()));
+                locals.push_back(local_t{serial, arenas.back().get()});
+                return *arenas.back();
+            }
+
+            fs::node_arena &arena(const fs::node_id node) { return *arenas[node >> fs::node_arena_shift]; }
+            const fs::node_arena &arena(const fs::node_id node) const { return *arenas[node >> fs::node_arena_shift]; }
+
+            std::size_t size() const {
+                std::size_t count {0};
+                for (const auto &node_arena: arenas)
+                    count += node_arena->size();
+                return count;
+            }
+
+            std::vector<fs::node_id> children(const fs::node_id node) const {
+                const fs::node_arena &parent_arena { arena(node) };
+                std::vector<fs::node_id> result {};
+                if (parent_arena.child_count(node) == 0)
+                    return result;
+                const fs::node_id first { parent_arena.first_child(node) };
+                for (unsigned int i = 0; i < parent_arena.child_count(node); i++)
+                    result.push_back(first + i);
+                return result;
+            }
+
+            // Full path of the node, rebuilt from the names of its ancestors
+            std::string path(const fs::node_id node) const {
+                const fs::node_id parent { arena(node).parent(node) };
+                if (parent == fs::no_node)
+                    return arena(node).name(node);
+                std::string result { path(parent) };
+                if (result.empty() || result.back() != '/')
+                    result += '/';
+                return result + arena(node).name(node);
+            }
+
+            fs::file_info_t to_file_info(const fs::node_id node) const {
+                const fs::node_arena &node_arena { arena(node) };
+                fs::file_info_t fi {};
+                fi.error = node_arena.error(node);
+                fi.fields = fs::file_field::field_type | fs::file_field::field_length | fs::file_field::field_access_time | fs::file_field::field_modify_time | fs::file_field::field_change_time;
+                fi.type = node_arena.type(node);
+                fi.length = node_arena.length(node);
+                fi.access_time = node_arena.access_time(node);
+                fi.modify_time = node_arena.modify_time(node);
+                fi.change_time = node_arena.change_time(node);
+                const fs::node_id parent { node_arena.parent(node) };
+                if (parent == fs::no_node) {
+                    fi.path = fs::dirname(node_arena.name(node));
+                    fi.name = fs::basename(node_arena.name(node));
+                }
+                else {
+                    fi.path = path(parent);
+                    fi.name = node_arena.name(node);
+                }
+                return fi;
+            }
+    };
+
+    /*
+        Serial scan of the directory's contents, appended as children of the
+        node. on_directory(dir, node) is called for every directory before it
+        is listed. Once 'cancelled' is set, subdirectories are not entered and
+        are kept incomplete. The errors of the entries are propagated to
+        'error', returns the length of the contents.
+    */
+    template<typename T> unsigned long scan_subtree(fs::node_tree &tree, const fs::node_id node, const fs::directory &dir, const unsigned int fields, const fs::mount_policy *policy, const std::atomic_bool *cancelled, fs::file_error &error, T on_directory) {
+        on_directory(dir, node);
+        fs::node_arena &arena = tree.local_arena();
+        std::vector<fs::node_id> nodes {};
+        std::vector<fs::file_stat_t> stats {};
+        fs::read_entries(dir, [&] (const fs::dirent_t &dirent) {
+            nodes.push_back(arena.append(node, dirent.name, dirent.type));
+            stats.push_back(fs::file_stat_t{});
+            stats.back().inode = dirent.inode;
+        });
+        if (nodes.empty())
+            return 0;
+
+        std::vector<fs::file_stat_t *> files {};
+        std::vector<const char *> names {};
+        for (std::size_t i = 0; i < nodes.size(); i++) {
+            files.push_back(&stats[i]);
+            names.push_back(arena.name(nodes[i]));
+        }
+        fs::stat_files(dir, files, names, fields, fs::io_backend::sync);
+
+        // note: performed after all entries are appended, the children of a node form a contiguous range
+        for (std::size_t i = 0; i < nodes.size(); i++) {
+            if (stats[i].type == fs::file_type::directory && (policy == nullptr || policy->may_enter(dir, names[i]))) {
+                if (cancelled != nullptr && cancelled->load()) {
+                    stats[i].error = fs::file_error::incomplete;
+                }
+                else {
+                    std::shared_ptr<fs::directory> child_dir = fs::open_directory(dir, names[i]);
+                    fs::file_error child_error {fs::file_error::none};
+                    if (child_dir == nullptr)
+                        child_error = fs::to_file_error(errno);
+                    else if (policy == nullptr || policy->may_enter(*child_dir))
+                        stats[i].length += scan_subtree(tree, nodes[i], *child_dir, fields, policy, cancelled, child_error, on_directory);
+                    if (stats[i].error == fs::file_error::none || child_error == fs::file_error::incomplete)
+                        stats[i].error = child_error;
+                }
+            }
+            fs::propagate_error(error, stats[i].error);
+            arena.set_stat(nodes[i], stats[i]);
+        }
+        arena.set_children(node, nodes.front(), nodes.size());
+        return arena.sum_lengths(nodes.front(), nodes.size());
+    }
+}
+
+#endif //__NODE_TREE_HPP_INCLUDED__
@@ -0,0 +1,69 @@
+#ifndef __PLANNING_HPP_INCLUDED__
+#define __PLANNING_HPP_INCLUDED__
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "fs.hpp"
+#include "node_tree.hpp"
+
+namespace planning {
+    // Prefix tree of the directory targets by path component
+    struct target_plan_t {
+        std::vector<std::size_t> targets {}; // indices of the targets naming this directory
+        std::map<std::string, std::size_t, std::less<>> children {}; // indices into the plan
+    };
+
+    // Adds the canonical path of the target to the plan, returns the index of its node
+    std::size_t add_plan_target(std::vector<planning::target_plan_t> &plan, const std::string &path, const std::size_t target) {
+        if (plan.empty())
+            plan.emplace_back(); // "/"
+        std::size_t node {0};
+        for (std::size_t start = 0; start < path.length();) {
+            const std::size_t end { std::min(path.find('/', start), path.length()) };
+            if (end > start) {
+                const std::string name { path.substr(start, end - start) };
+                const auto found = plan[node].children.find(name);
+                if (found != plan[node].children.end()) {
+                    node = found->second;
+                }
+                else {
+                    plan[node].children.emplace(name, plan.size());
+                    node = plan.size();
+                    plan.emplace_back();
+                }
+            }
+            start = end + 1;
+        }
+        plan[node].targets.push_back(target);
+        return node;
+    }
+
+    // Outermost targets which are not resolved yet, the ones nested below are resolved by parsing these
+    void collect_plan_roots(const std::vector<planning::target_plan_t> &plan, const std::size_t node, const std::vector<bool> &resolved, std::vector<std::size_t> &roots) {
+        for (const std::size_t target: plan[node].targets) {
+            if (!resolved[target]) {
+                roots.push_back(target);
+                return;
+            }
+        }
+        for (const auto &child: plan[node].children)
+            planning::collect_plan_roots(plan, child.second, resolved, roots);
+    }
+
+    // Length of the targets parsed on their own, nested and duplicate targets are part of an outer one and counted by it
+    unsigned long root_length(const std::vector<fs::file_info_t> &targets, const std::vector<fs::node_id> &roots) {
+        unsigned long length {0};
+        for (std::size_t i = 0; i < std::min(targets.size(), roots.size()); i++) {
+            if (roots[i] != fs::no_node)
+                length += targets[i].length;
+        }
+        return length;
+    }
+}
+
+#endif //__PLANNING_HPP_INCLUDED__
@@ -0,0 +1,55 @@
+#ifndef __SHARDED_SET_HPP_INCLUDED__
+#define __SHARDED_SET_HPP_INCLUDED__
+
+#include <array>
+#include <mutex>
+#include <functional>
+#include <unordered_set>
+
+namespace threading {
+    /*
+        Concurrent hash set split into 2^shard_bits independently locked
+        shards. The shard is picked by the high bits of the (remixed) hash, so
+        threads inserting unrelated values rarely contend for the same lock.
+    */
+    template<typename T, typename H = std::hash<T>, unsigned int shard_bits = 6>
+    class sharded_set {
+        private:
+            struct alignas(64) shard_t {
+                std::mutex mutex {};
+                std::unordered_set<T, H> values {};
+            };
+
+            std::array<shard_t, 1u << shard_bits> shards {};
+
+            shard_t &get_shard(const T &value) {
+                const unsigned long long hash { static_cast<unsigned long long>(H{}(value)) * 0x9E3779B97F4A7C15ull };
+                return shards[hash >> (64 - shard_bits)];
+            }
+
+        public:
+            // Returns true if the value was not yet part of the set
+            bool insert(const T &value) {
+                shard_t &shard = get_shard(value);
+                std::lock_guard<std::mutex> shard_lock(shard.mutex);
+                return shard.values.insert(value).second;
+            }
+
+            bool contains(const T &value) {
+                shard_t &shard = get_shard(value);
+                std::lock_guard<std::mutex> shard_lock(shard.mutex);
+                return shard.values.find(value) != shard.values.end();
+            }
+
+            std::size_t size() {
+                std::size_t count {0};
+                for (auto &shard: shards) {
+                    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+                    count += shard.values.size();
+                }
+                return count;
+            }
+    };
+}
+
+#endif //__SHARDED_SET_HPP_INCLUDED__
@@ -0,0 +1,311 @@
+#ifndef __SNAPSHOT_HPP_INCLUDED__
+#define __SNAPSHOT_HPP_INCLUDED__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h> // open()
+#include <sys/mman.h> // mmap()
+#include <sys/stat.h>
+#include <string.h> // memcmp()
+#include <unistd.h> // close()
+
+#include "fs.hpp"
+#include "node_tree.hpp"
+
+namespace fs {
+    /*
+        Scanned tree stored to a file, read back without touching the file
+        system. The file consists of a header, fixed size node records and the
+        NUL-terminated names. Nodes are stored breadth first, the roots first,
+        hence the children of a node are a contiguous range of records. They
+        are sorted by name, entries are looked up by binary search and two
+        snapshots are compared by merging the children of a directory.
+    */
+    class snapshot {
+        private:
+            struct header_t {
+                char magic[8];
+                unsigned long version;
+                unsigned long node_count;
+                unsigned long root_count;
+                unsigned long names_length;
+            };
+
+            struct node_t {
+                unsigned long length;
+                unsigned long parent;
+                unsigned long first_child;
+                unsigned long name_offset;
+                unsigned int child_count;
+                unsigned int access_time;
+                unsigned int modify_time;
+                unsigned int change_time;
+                fs::file_type type;
+                fs::file_error error;
+            };
+
+            static constexpr char magic[8] {'d', 'u', 's', 's', 'n', 'a', 'p', '\0'};
+            static constexpr unsigned long version {1};
+
+            void *mapping {MAP_FAILED};
+            std::size_t mapping_size {0};
+            header_t header {};
+            const node_t *nodes {nullptr};
+            const char *names {nullptr};
+
+            // Node records are only read through this, an index out of range is a corrupt file
+            const node_t &get(const unsigned long node) const {
+                if (node >= header.node_count)
+                    throw std::runtime_error("Invalid snapshot node: " + std::to_string(node));
+                return nodes[node];
+            }
+
+        public:
+            static constexpr unsigned long no_node {~0ul};
+
+            snapshot() = delete;
+            snapshot(const snapshot &) = delete;
+            snapshot &operator=(const snapshot &) = delete;
+
+            snapshot(const std::string &path) {
+                const int fd { open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+                if (fd == -1)
+                    throw std::runtime_error("Failed to open snapshot: " + path);
+                struct stat sb;
+                if (fstat(fd, &sb) == -1 || static_cast<std::size_t>(sb.st_size) < sizeof(header_t)) {
+                    close(fd);
+                    throw std::runtime_error("Invalid snapshot: " + path);
+                }
+                mapping_size = sb.st_size;
+                mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                close(fd);
+                if (mapping == MAP_FAILED)
+                    throw std::runtime_error("Failed to map snapshot: " + path);
+
+                header = *static_cast<const header_t *>(mapping);
+                const std::size_t expected_size { sizeof(header_t) + header.node_count * sizeof(node_t) + header.names_length };
+                if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.root_count > header.node_count || expected_size != mapping_size || (header.names_length > 0 && static_cast<const char *>(mapping)[mapping_size - 1] != '\0')) {
+                    munmap(mapping, mapping_size);
+                    throw std::runtime_error("Invalid snapshot: " + path);
+                }
+                nodes = reinterpret_cast<const node_t *>(static_cast<const char *>(mapping) + sizeof(header_t));
+                names = reinterpret_cast<const char *>(nodes + header.node_count);
+            }
+
+            ~snapshot() {
+                if (mapping != MAP_FAILED)
+                    munmap(mapping, mapping_size);
+            }
+
+            /*
+                Writes the trees below the given roots of the node tree. The
+                nodes are written while traversing, only the names are kept
+                in memory until the end.
+            */
+            static void write(const std::string &path, const fs::node_tree &tree, const std::vector<fs::node_id> &roots) {
+                struct queued_t {
+                    fs::node_id node;
+                    unsigned long parent;
+                };
+                std::deque<queued_t> queue {};
+                for (const fs::node_id root: roots)
+                    queue.push_back(queued_t{root, no_node});
+
+                const std::string temp_path { path + ".tmp" };
+                std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+                header_t temp {};
+                file.write(reinterpret_cast<const char *>(&temp), sizeof(temp)); // note: rewritten once the counts are known
+
+                std::string node_names {};
+                std::vector<fs::node_id> children {};
+                unsigned long index {0};
+                unsigned long next_index { queue.size() };
+                for (; !queue.empty(); index++) {
+                    const queued_t queued { queue.front() };
+                    queue.pop_front();
+                    const fs::node_arena &arena { tree.arena(queued.node) };
+
+                    children.clear();
+                    if (arena.child_count(queued.node) > 0) {
+                        for (unsigned int i = 0; i < arena.child_count(queued.node); i++)
+                            children.push_back(arena.first_child(queued.node) + i);
+                        const fs::node_arena &child_arena { tree.arena(children.front()) };
+                        std::sort(children.begin(), children.end(), [&child_arena] (const fs::node_id a, const fs::node_id b) { return strcmp(child_arena.name(a), child_arena.name(b)) < 0; });
+                    }
+
+                    node_t record {};
+                    record.length = arena.length(queued.node);
+                    record.parent = queued.parent;
+                    record.first_child = children.empty() ? no_node : next_index;
+                    record.name_offset = node_names.length();
+                    record.child_count = children.size();
+                    record.access_time = arena.access_time(queued.node);
+                    record.modify_time = arena.modify_time(queued.node);
+                    record.change_time = arena.change_time(queued.node);
+                    record.type = arena.type(queued.node);
+                    record.error = arena.error(queued.node);
+                    file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+                    node_names += arena.name(queued.node);
+                    node_names += '\0';
+
+                    for (const fs::node_id child: children)
+                        queue.push_back(queued_t{child, index});
+                    next_index += children.size();
+                }
+                file.write(node_names.data(), node_names.length());
+
+                memcpy(temp.magic, magic, sizeof(magic));
+                temp.version = version;
+                temp.node_count = index;
+                temp.root_count = roots.size();
+                temp.names_length = node_names.length();
+                file.seekp(0);
+                file.write(reinterpret_cast<const char *>(&temp), sizeof(temp));
+                file.close();
+                if (!file.good())
+                    throw std::runtime_error("Failed to write snapshot: " + temp_path);
+                if (rename(temp_path.c_str(), path.c_str()) == -1)
+                    throw std::runtime_error("Failed to replace snapshot: " + path);
+            }
+
+            unsigned long size() const { return header.node_count; }
+            unsigned long root_count() const { return header.root_count; }
+
+            unsigned long length(const unsigned long node) const { return get(node).length; }
+            fs::file_type type(const unsigned long node) const { return get(node).type; }
+            unsigned long parent(const unsigned long node) const { return get(node).parent; }
+            unsigned long first_child(const unsigned long node) const { return get(node).first_child; }
+            unsigned int child_count(const unsigned long node) const { return get(node).child_count; }
+
+            const char *name(const unsigned long node) const {
+                const node_t &record { get(node) };
+                if (record.name_offset >= header.names_length)
+                    throw std::runtime_error("Invalid snapshot name: " + std::to_string(node));
+                return names + record.name_offset;
+            }
+
+            // Child of the node by name, binary search within the sorted children
+            unsigned long find_child(const unsigned long node, const std::string_view &child_name) const {
+                const node_t &record { get(node) };
+                unsigned long low { record.first_child };
+                unsigned long high { record.first_child + record.child_count };
+                while (low < high) {
+                    const unsigned long middle { low + (high - low) / 2 };
+                    const int result { std::string_view(name(middle)).compare(child_name) };
+                    if (result == 0)
+                        return middle;
+                    if (result < 0)
+                        low = middle + 1;
+                    else
+                        high = middle;
+                }
+                return no_node;
+            }
+
+            // Node of the absolute path, looked up from the root containing it
+            unsigned long find(const std::string &path) const {
+                for (unsigned long root = 0; root < header.root_count; root++) {
+                    std::string_view root_name { name(root) };
+                    if (path.compare(0, root_name.length(), root_name) != 0)
+                        continue;
+                    if (path.length() == root_name.length())
+                        return root;
+                    if (path[root_name.length()] != '/' && root_name.back() != '/')
+                        continue;
+
+                    unsigned long node { root };
+                    std::size_t start { root_name.length() };
+                    while (node != no_node && start < path.length()) {
+                        if (path[start] == '/') {
+                            start++;
+                            continue;
+                        }
+                        const std::size_t end { std::min(path.find('/', start), path.length()) };
+                        node = find_child(node, std::string_view(path).substr(start, end - start));
+                        start = end;
+                    }
+                    if (node != no_node)
+                        return node;
+                }
+                return no_node;
+            }
+
+            std::string path(const unsigned long node) const {
+                const unsigned long parent_node { parent(node) };
+                if (parent_node == no_node)
+                    return name(node);
+                std::string result { path(parent_node) };
+                if (result.empty() || result.back() != '/')
+                    result += '/';
+                return result + name(node);
+            }
+
+            fs::file_info_t to_file_info(const unsigned long node) const {
+                const node_t &record { get(node) };
+                fs::file_info_t fi {};
+                fi.error = record.error;
+                fi.fields = fs::file_field::field_type | fs::file_field::field_length | fs::file_field::field_access_time | fs::file_field::field_modify_time | fs::file_field::field_change_time;
+                fi.type = record.type;
+                fi.length = record.length;
+                fi.access_time = record.access_time;
+                fi.modify_time = record.modify_time;
+                fi.change_time = record.change_time;
+                if (record.parent == no_node) {
+                    fi.path = fs::dirname(name(node));
+                    fi.name = fs::basename(name(node));
+                }
+                else {
+                    fi.path = path(record.parent);
+                    fi.name = name(node);
+                }
+                return fi;
+            }
+    };
+
+    // Change of an entry between two snapshots, the file is taken from the newer one unless removed
+    struct snapshot_change_t {
+        fs::file_info_t file;
+        long delta;
+    };
+
+    /*
+        Changed entries of a directory between two snapshots, by merging their
+        sorted children. Only the given directory level is visited, the
+        lengths of directories are aggregated already.
+    */
+    std::vector<fs::snapshot_change_t> diff_snapshots(const fs::snapshot &older, const unsigned long older_node, const fs::snapshot &newer, const unsigned long newer_node) {
+        std::vector<fs::snapshot_change_t> changes {};
+        unsigned long older_child { older_node != fs::snapshot::no_node ? older.first_child(older_node) : 0 };
+        const unsigned long older_end { older_node != fs::snapshot::no_node && older.child_count(older_node) > 0 ? older_child + older.child_count(older_node) : older_child };
+        unsigned long newer_child { newer_node != fs::snapshot::no_node ? newer.first_child(newer_node) : 0 };
+        const unsigned long newer_end { newer_node != fs::snapshot::no_node && newer.child_count(newer_node) > 0 ? newer_child + newer.child_count(newer_node) : newer_child };
+
+        while (older_child < older_end || newer_child < newer_end) {
+            const int result { older_child == older_end ? 1 : newer_child == newer_end ? -1 : strcmp(older.name(older_child), newer.name(newer_child)) };
+            if (result < 0) {
+                changes.push_back(fs::snapshot_change_t{older.to_file_info(older_child), -static_cast<long>(older.length(older_child))});
+                older_child++;
+            }
+            else if (result > 0) {
+                changes.push_back(fs::snapshot_change_t{newer.to_file_info(newer_child), static_cast<long>(newer.length(newer_child))});
+                newer_child++;
+            }
+            else {
+                const long delta { static_cast<long>(newer.length(newer_child)) - static_cast<long>(older.length(older_child)) };
+                if (delta != 0 || newer.type(newer_child) != older.type(older_child))
+                    changes.push_back(fs::snapshot_change_t{newer.to_file_info(newer_child), delta});
+                older_child++;
+                newer_child++;
+            }
+        }
+        return changes;
+    }
+}
+
+#endif //__SNAPSHOT_HPP_INCLUDED__
@@ -0,0 +1,33 @@
+#ifndef __SORTING_HPP_INCLUDED__
+#define __SORTING_HPP_INCLUDED__
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+namespace sorting {
+    // Head sizes up to 1/partial_sort_ratio of the range are selected by heap (std::partial_sort), see performance_sort_head()
+    constexpr std::size_t partial_sort_ratio {100};
+
+    /*
+        Sorts the first 'count' elements of the range as a full sort would,
+        the order of the remaining elements is unspecified. Small heads are
+        selected by a bounded heap in O(n log count), larger ones by
+        std::nth_element and a sort of the head in O(n + count log count).
+    */
+    template<typename I, typename C> void sort_head(const I first, const I last, const std::size_t count, C compare) {
+        const std::size_t length { static_cast<std::size_t>(std::distance(first, last)) };
+        if (count >= length) {
+            std::sort(first, last, compare);
+        }
+        else if (count * sorting::partial_sort_ratio <= length) {
+            std::partial_sort(first, first + count, last, compare);
+        }
+        else {
+            std::nth_element(first, first + count, last, compare);
+            std::sort(first, first + count, compare);
+        }
+    }
+}
+
+#endif //__SORTING_HPP_INCLUDED__
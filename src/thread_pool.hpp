@@ -4,15 +4,25 @@
 #include <future>
 #include <thread>
 #include <mutex>
-#include <shared_mutex>
 #include <atomic>
-#include <map>
-#include <set>
-#include <queue>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <condition_variable>
 #include <stdexcept>
+#include <new>
+#include <cstddef>
+#include <type_traits>
 
 #include <iostream>
 
+#include <linux/futex.h> // FUTEX_WAIT_PRIVATE
+#include <sys/syscall.h> // SYS_futex
+#include <unistd.h> // syscall()
+
+#include "work_deque.hpp"
+
 namespace threading {
     enum class task_status {
         pending,
@@ -27,26 +37,149 @@ namespace threading {
         std::thread thread;
     };
 
+    /*
+        Parking of idle threads on a futex. A thread announces the wait by
+        prepare_wait(), checks for work once more and then waits for the
+        returned epoch to change, hence no notification is lost in between.
+        Notifying is a single atomic load while nobody waits. A thread
+        publishing work with plain release stores (e.g. a deque push) needs a
+        seq_cst fence before checking waiting(), or the load may pass the
+        stores and miss a thread that just announced its wait.
+    */
+    class event_count {
+        private:
+            std::atomic_uint epoch {0};
+            std::atomic_uint waiters {0};
+
+        public:
+            unsigned int prepare_wait() {
+                waiters.fetch_add(1, std::memory_order_seq_cst);
+                return epoch.load(std::memory_order_seq_cst);
+            }
+
+            void cancel_wait() {
+                waiters.fetch_sub(1, std::memory_order_seq_cst);
+            }
+
+            void wait(const unsigned int key) {
+                while (epoch.load(std::memory_order_seq_cst) == key)
+                    syscall(SYS_futex, reinterpret_cast<unsigned int *>(&epoch), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+                waiters.fetch_sub(1, std::memory_order_seq_cst);
+            }
+
+            // Wakes up to 'count' waiting threads
+            void notify(const int count) {
+                if (waiters.load(std::memory_order_seq_cst) == 0)
+                    return;
+                epoch.fetch_add(1, std::memory_order_seq_cst);
+                syscall(SYS_futex, reinterpret_cast<unsigned int *>(&epoch), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+            }
+
+            unsigned int waiting() const {
+                return waiters.load(std::memory_order_relaxed);
+            }
+    };
+
+    /*
+        Join counter of tasks: the continuation runs once every task added to
+        the group and every nested group completed, in the thread completing
+        the last of them. Nothing waits for the group. The creator holds a
+        reference until thread_pool::close_group(), hence the continuation
+        does not run before all tasks are added.
+    */
+    class task_group {
+        friend class thread_pool;
+
+        private:
+            std::atomic_ulong pending {1};
+            std::function<void ()> continuation;
+            task_group *parent;
+
+        public:
+            task_group(const task_group &) = delete;
+            task_group &operator=(const task_group &) = delete;
+
+            // A nested group holds a reference on its parent until its own continuation ran
+            task_group(std::function<void ()> continuation_, task_group *parent_ = nullptr) : continuation(std::move(continuation_)), parent(parent_) {
+                if (parent != nullptr)
+                    parent->pending++;
+            }
+    };
+
     struct task_t {
         task_status status;
         const std::function<void (const std::function<bool (const std::shared_ptr<task_t> &)> &)> callback;
     };
 
+    /*
+        Queued task, recycled through the freelist of the executing worker,
+        or the shared one of threads outside of the pool once the worker's
+        freelist is full. Callables up to inline_size bytes are constructed in place, larger
+        ones are allocated. Completion is signalled through the group only,
+        there is no handle to the task.
+    */
+    class task_slot {
+        friend class thread_pool;
+
+        public:
+            static constexpr std::size_t inline_size {64};
+
+        private:
+            alignas(std::max_align_t) unsigned char storage[inline_size];
+            void *callable {nullptr};
+            void (*invoke)(task_slot &, unsigned int, bool) {nullptr}; // runs the callable unless aborted, then destroys it
+            threading::task_group *group {nullptr};
+            task_slot *next {nullptr}; // in the freelist
+    };
+
     class thread_pool {
+        /*
+            State of a worker, kept in a contiguous array. Its deque is only
+            pushed to by the worker itself, tasks added by other threads are
+            put into its inbox and moved to the deque once the worker runs out
+            of tasks. Other workers steal from the top of the deque without
+            locking. Tasks are counted per worker, the pool is idle once the
+            sums of added and completed tasks are equal.
+        */
+        struct alignas(64) worker_state_t {
+            threading::work_deque<task_slot> tasks {};
+            std::mutex mutex {};
+            std::deque<task_slot *> inbox {};
+            std::atomic_ulong inbox_size {0}; // checked before locking the inbox
+            task_slot *free_slots {nullptr}; // owner only
+            std::size_t free_slot_count {0}; // owner only
+            std::atomic_ulong added_tasks {0}; // queued to the deque or the inbox of this worker
+            std::atomic_ulong completed_tasks {0}; // executed or aborted by this worker
+        };
+
+        // Pool and index of the worker running on this thread, slots are taken from its freelist
+        static inline thread_local const thread_pool *current_pool {nullptr};
+        static inline thread_local unsigned int current_worker_index {0};
+
+        // Idle workers retry this often (yielding in between) before parking
+        static constexpr unsigned int spin_count {64};
+        // Spawned tasks the spawning worker runs itself once its current task returned, parked workers are only woken for the ones beyond
+        static constexpr long wake_threshold {1};
+        // Slots kept by each freelist, further released slots are deleted
+        static constexpr std::size_t max_free_slots {4096};
+
         std::atomic_bool destruct {false};
         std::atomic_bool abort {false};
         const unsigned int thread_count;
         std::vector<worker_t> workers {};
-        std::map<unsigned int, std::queue<std::shared_ptr<task_t>>> task_queues {};
-        std::shared_mutex workers_idle_mutex {};
-        std::set<unsigned int> workers_idle {};
-        std::map<unsigned int, std::mutex> mutexes {};
-        std::map<unsigned int, std::condition_variable> task_notifiers {};
+        std::unique_ptr<worker_state_t[]> states {nullptr};
+        threading::event_count idle {};
         std::atomic_ulong next_worker_index {0};
+        std::atomic_uint waiting_threads {0}; // in wait(), workers running out of tasks check for idle then
 
         std::mutex wait_mutex {};
         std::condition_variable wait_notifier {};
 
+        // Freelist of threads outside of the pool, filled by workers whose own freelist is full
+        std::mutex shared_slots_mutex {};
+        task_slot *shared_free_slots {nullptr};
+        std::size_t shared_free_slot_count {0};
+
         inline bool has_completed(const std::shared_ptr<task_t> &wait_for_task) const {
             if (wait_for_task == nullptr)
                 return true;
@@ -54,29 +187,55 @@ namespace threading {
             return (wait_for_task->status == task_status::done || wait_for_task->status == task_status::failed || wait_for_task->status == task_status::aborted);
         }
 
-        inline bool is_worker_idle(const unsigned int worker_index) {
-            std::shared_lock<std::shared_mutex> workers_idle_lock(workers_idle_mutex);
-            return workers_idle.find(worker_index) != workers_idle.end();
+        // Next task of the worker's own deque, the inbox is moved to the deque once it is empty
+        task_slot *pop_task(const unsigned int worker_index) {
+            worker_state_t &state = states[worker_index];
+            task_slot *task { state.tasks.pop() };
+            if (task != nullptr || state.inbox_size.load() == 0)
+                return task;
+
+            std::lock_guard<std::mutex> thread_lock(state.mutex);
+            if (state.inbox.empty())
+                return nullptr;
+            for (auto inbox_task = state.inbox.rbegin(); inbox_task != state.inbox.rend(); inbox_task++)
+                state.tasks.push(*inbox_task); // note: reversed, tasks added by other threads are started in order
+            state.inbox.clear();
+            state.inbox_size.store(0);
+            task = state.tasks.pop();
+            wake_thieves(state, 0); // note: the popped task is run right away, the remaining ones are surplus
+            return task;
         }
 
-        std::shared_ptr<task_t> steal_task(const unsigned int worker_index) {
-            std::this_thread::yield(); // relaxation: let potential owner threads get task first
+        // Parked workers are woken for the tasks of the deque beyond the ones its owner is about to run
+        inline void wake_thieves(const worker_state_t &state, const long owned) {
+            const long surplus { state.tasks.size() - owned };
+            if (surplus <= 0)
+                return;
+            std::atomic_thread_fence(std::memory_order_seq_cst); // note: pairs with prepare_wait(), see event_count
+            if (idle.waiting() > 0)
+                idle.notify(static_cast<int>(std::min<long>(surplus, thread_count)));
+        }
 
-            // TODO: inefficient when most threads are asleep (cv.wait()) and one thread has many tasks
+        task_slot *steal_task(const unsigned int worker_index) {
             for (unsigned int i = 1; i < thread_count; i++) {
                 const unsigned int other_worker_index = (worker_index + i) % thread_count;
-                {
-                    std::lock_guard<std::mutex> other_lock(mutexes[other_worker_index]);
-                    if (task_queues[other_worker_index].size() <= is_worker_idle(other_worker_index) ? 1 : 0)
+                task_slot *task { states[other_worker_index].tasks.steal() };
+                if (task == nullptr) {
+                    // Tasks not yet moved to the deque of a busy worker
+                    worker_state_t &other_state = states[other_worker_index];
+                    if (other_state.inbox_size.load() == 0)
+                        continue;
+                    std::lock_guard<std::mutex> other_lock(other_state.mutex);
+                    if (other_state.inbox.empty())
                         continue;
+                    task = other_state.inbox.front();
+                    other_state.inbox.pop_front();
+                    other_state.inbox_size--;
+                }
 #ifdef DEBUG
-                    std::cout << "[" << worker_index << "] stealing task from [" << other_worker_index << "]" << std::endl;
+                std::cout << "[" << worker_index << "] stealing task from [" << other_worker_index << "]" << std::endl;
 #endif
-                    // steal task
-                    std::shared_ptr<task_t> task = task_queues[other_worker_index].front();
-                    task_queues[other_worker_index].pop();
-                    return task;
-                }
+                return task;
             }
             return nullptr;
         }
@@ -85,109 +244,233 @@ namespace threading {
             if (wait_for_task != nullptr && has_completed(wait_for_task))
                 return false;
 
-            std::unique_lock<std::mutex> thread_lock(mutexes[worker_index]);
-            if (task_queues[worker_index].size() == 0) {
-                thread_lock.unlock();
-                if (wait_for_task != nullptr && !has_completed(wait_for_task)) {
-                    std::shared_ptr<task_t> task = steal_task(worker_index);
-                    if (task != nullptr)
-                        execute_task(worker_index, *task);
-                    std::this_thread::yield();
-                }
-                return true;
-            }
-
-            // pop and execute next task
-            auto task = task_queues[worker_index].front();
-            task_queues[worker_index].pop();
-            thread_lock.unlock();
-            execute_task(worker_index, *task);
+            task_slot *task { pop_task(worker_index) };
+            if (task == nullptr && wait_for_task != nullptr)
+                task = steal_task(worker_index);
+            if (task != nullptr)
+                execute_task(worker_index, *task);
             std::this_thread::yield();
             return true;
         }
 
-        inline void execute_task(const unsigned int worker_index, task_t &task) {
-            if (abort.load()) {
-                task.status = task_status::aborted;
+        inline void execute_task(const unsigned int worker_index, task_slot &slot) {
+            const bool aborted { abort.load() };
 #ifdef DEBUG
+            if (aborted)
                 std::cout << "[" << worker_index << "] arborting task" << std::endl;
 #endif
-                return;
-            }
+            slot.invoke(slot, worker_index, aborted);
+            release_group(slot.group); // note: before the task is completed, wait() returns after the continuations ran
 
+            worker_state_t &state = states[worker_index];
+            release_slot(state, slot);
+            state.completed_tasks++; // note: seq_cst, pairs with the increment of waiting_threads in wait()
+        }
+
+        template<typename F> static constexpr bool stored_inline() {
+            return sizeof(F) <= task_slot::inline_size && alignof(F) <= alignof(std::max_align_t);
+        }
+
+        template<typename F> static void invoke_slot(task_slot &slot, const unsigned int worker_index, const bool aborted) {
+            F &callable = *static_cast<F *>(slot.callable);
             try {
-                task.status = task_status::in_progress;
-                task.callback([this, worker_index] (const std::shared_ptr<task_t> &wait_for_task = nullptr) { return thread_yield(worker_index, wait_for_task); });
-                task.status = task_status::done;
-#ifdef DEBUG
-                std::cout << "[" << worker_index << "] completed task" << std::endl;
-#endif
+                callable(worker_index, aborted);
+            }
+            catch (const std::exception &e) {
+                std::cerr << "[" << worker_index << "] task failed: " << e.what() << std::endl; // note: the group's part is completed anyway
             }
             catch (...) {
-                task.status = task_status::failed;
+                std::cerr << "[" << worker_index << "] task failed" << std::endl;
             }
+            if constexpr (stored_inline<F>())
+                callable.~F();
+            else
+                delete &callable;
+            slot.callable = nullptr;
         }
 
-        void thread_loop(const unsigned int worker_index) {
-            std::unique_lock<std::mutex> thread_lock(mutexes[worker_index], std::defer_lock);
-            while (!destruct.load()) {
-                std::shared_ptr<task_t> task = nullptr;
-
-                thread_lock.lock();
-                if (task_queues[worker_index].size() == 0) {
-                    thread_lock.unlock(); // release lock to prevent deadlocks while stealing
-
-                    task = steal_task(worker_index);
-                    if (task == nullptr) {
-                        // wait for new task
-                        thread_lock.lock();
-                        if (task_queues[worker_index].size() == 0) {
-                            {
-                                std::lock_guard<std::mutex> wait_lock(wait_mutex);
-                                {
-                                    std::lock_guard<std::shared_mutex> workers_idle_lock(workers_idle_mutex);
-                                    workers_idle.insert(worker_index);
-                                }
-                                wait_notifier.notify_all(); // tell waiters to evaluate task queues
-                            }
-#ifdef DEBUG
-                            std::cout << "[" << worker_index << "] idle" << std::endl;
-#endif
-                            task_notifiers[worker_index].wait(thread_lock);
+        // Slot of the calling worker's freelist or of the shared one, allocated if empty
+        task_slot *acquire_slot() {
+            if (current_pool == this) {
+                worker_state_t &state = states[current_worker_index];
+                if (state.free_slots == nullptr)
+                    return new task_slot;
+                task_slot *slot { state.free_slots };
+                state.free_slots = slot->next;
+                state.free_slot_count--;
+                return slot;
+            }
+
+            std::lock_guard<std::mutex> slots_lock(shared_slots_mutex);
+            if (shared_free_slots == nullptr)
+                return new task_slot;
+            task_slot *slot { shared_free_slots };
+            shared_free_slots = slot->next;
+            shared_free_slot_count--;
+            return slot;
+        }
+
+        // Executed slot back to the executing worker's freelist, to the shared one if full
+        void release_slot(worker_state_t &state, task_slot &slot) {
+            if (state.free_slot_count < max_free_slots) {
+                slot.next = state.free_slots;
+                state.free_slots = &slot;
+                state.free_slot_count++;
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> slots_lock(shared_slots_mutex);
+                if (shared_free_slot_count < max_free_slots) {
+                    slot.next = shared_free_slots;
+                    shared_free_slots = &slot;
+                    shared_free_slot_count++;
+                    return;
+                }
+            }
+            delete &slot;
+        }
+
+        // Slot of the callable, invoked as callable(worker_index, aborted) by the executing worker
+        template<typename F> task_slot *make_slot(F &&callable, threading::task_group *group) {
+            using callable_t = std::decay_t<F>;
+            task_slot *slot { acquire_slot() };
+            if constexpr (stored_inline<callable_t>())
+                slot->callable = new (slot->storage) callable_t(std::forward<F>(callable));
+            else
+                slot->callable = new callable_t(std::forward<F>(callable));
+            slot->invoke = &invoke_slot<callable_t>;
+            slot->group = group;
+            slot->next = nullptr;
+            return slot;
+        }
+
+        template<typename F> static auto unless_aborted(F &&task) {
+            return [task = std::forward<F>(task)] (const unsigned int, const bool aborted) mutable {
+                if (!aborted)
+                    task();
+            };
+        }
+
+        /*
+            Queues 'count' slots linked by their next pointers. Slots spawned
+            by a worker of the pool go onto its own deque, popped LIFO hence
+            depth-first, other workers are woken to steal the surplus. Slots
+            of other threads go into the inbox of one worker under a single
+            lock, waking as many parked workers as there are slots in one
+            notification. The group's part of each slot is completed once
+            executed or aborted.
+        */
+        void submit(task_slot *slots, const std::size_t count, threading::task_group *group) {
+            if (group != nullptr)
+                group->pending += count;
+
+            if (current_pool == this) {
+                worker_state_t &state = states[current_worker_index];
+                state.added_tasks += count;
+                while (slots != nullptr) {
+                    task_slot *next { slots->next };
+                    state.tasks.push(slots);
+                    slots = next;
+                }
 #ifdef DEBUG
-                            std::cout << "[" << worker_index << "] unleashed" << std::endl;
+                std::cout << "[" << current_worker_index << "] " << count << " task(s) spawned" << std::endl;
 #endif
-                            {
-                                std::lock_guard<std::shared_mutex> workers_idle_lock(workers_idle_mutex);
-                                workers_idle.erase(worker_index);
-                            }
-                            if (task_queues[worker_index].size() == 0) {
-                                thread_lock.unlock();
-                                continue; // stolen by other thread
-                            }
+                wake_thieves(state, wake_threshold);
+                return;
+            }
+
+            // TODO: begin with locating empty task queue, else perform logic below
+            unsigned int next_index = next_worker_index.fetch_add(1) % thread_count;
+            {
+                std::lock_guard<std::mutex> worker_lock(states[next_index].mutex);
+                states[next_index].added_tasks += count;
+                while (slots != nullptr) {
+                    task_slot *next { slots->next };
+                    states[next_index].inbox.push_back(slots);
+                    slots = next;
+                }
+                states[next_index].inbox_size += count;
 #ifdef DEBUG
-                            std::cout << "[" << worker_index << "] wake up" << std::endl;
+                std::cout << "[" << next_index << "] " << count << " task(s) added" << std::endl;
 #endif
-                        }
-                    }
+            }
+            idle.notify(static_cast<int>(std::min<std::size_t>(count, thread_count)));
+        }
+
+        // Releases a reference on the group, completed groups run their continuation and release their parent in turn
+        static void release_group(threading::task_group *group) {
+            while (group != nullptr && group->pending.fetch_sub(1) == 1) {
+                threading::task_group *parent { group->parent };
+                const std::function<void ()> continuation { std::move(group->continuation) }; // note: may destroy the group
+                try {
+                    continuation();
+                }
+                catch (const std::exception &e) {
+                    std::cerr << "continuation failed: " << e.what() << std::endl;
                 }
+                catch (...) {
+                    std::cerr << "continuation failed" << std::endl;
+                }
+                group = parent; // note: iterative, the stack does not grow with the depth of nested groups
+            }
+        }
+
+        /*
+            Wakes the threads in wait() once all tasks completed. Checked by
+            workers running out of tasks: the worker completing the last task
+            finds none afterwards, workers completing their last tasks
+            concurrently see each other's count (seq_cst).
+        */
+        void notify_if_idle() {
+            if (waiting_threads.load() == 0 || !all_tasks_idle())
+                return;
+            std::lock_guard<std::mutex> wait_lock(wait_mutex);
+            wait_notifier.notify_all();
+        }
 
-                // note: thread_lock locked if (task == nullptr)
+        task_slot *find_task(const unsigned int worker_index) {
+            task_slot *task { pop_task(worker_index) };
+            if (task == nullptr)
+                task = steal_task(worker_index);
+            return task;
+        }
 
-                if (destruct.load()) {
-                    if (task == nullptr)
-                        thread_lock.unlock();
-                    break;
+        void thread_loop(const unsigned int worker_index) {
+            current_pool = this;
+            current_worker_index = worker_index;
+            bool executed {false}; // since running out of tasks the last time
+            while (!destruct.load()) {
+                task_slot *task { find_task(worker_index) };
+                if (task == nullptr && executed) {
+                    notify_if_idle();
+                    executed = false;
+                }
+                for (unsigned int i = 0; task == nullptr && i < spin_count && !destruct.load(); i++) {
+                    std::this_thread::yield();
+                    task = find_task(worker_index);
                 }
 
                 if (task == nullptr) {
-                    // pop next task
-                    task = task_queues[worker_index].front();
-                    task_queues[worker_index].pop();
-                    thread_lock.unlock();
+                    // park until tasks are added, checked once more since added tasks only wake announced waiters
+                    const unsigned int key { idle.prepare_wait() };
+                    task = find_task(worker_index);
+                    if (task == nullptr && !destruct.load()) {
+#ifdef DEBUG
+                        std::cout << "[" << worker_index << "] idle" << std::endl;
+#endif
+                        idle.wait(key);
+#ifdef DEBUG
+                        std::cout << "[" << worker_index << "] wake up" << std::endl;
+#endif
+                        continue;
+                    }
+                    idle.cancel_wait();
+                    if (task == nullptr)
+                        break;
                 }
 
                 execute_task(worker_index, *task);
+                executed = true;
             }
         }
 
@@ -214,11 +497,7 @@ namespace threading {
                 if (thread_count < 1)
                     throw std::runtime_error("Thread count must be at least one: " + std::to_string(thread_count));
 
-                for (unsigned int i = 0; i < thread_count; i++) {
-                    mutexes[i];
-                    task_notifiers[i];
-                    task_queues[i];
-                }
+                states.reset(new worker_state_t[thread_count]);
                 for (unsigned int i = 0; i < thread_count; i++) {
                     workers.emplace_back(worker_t{i, std::thread{&thread_pool::safe_thread_loop, this, i}});
                 }
@@ -232,7 +511,7 @@ namespace threading {
 #ifdef DEBUG
                 std::cout << "abort all tasks..." << std::endl;
 #endif
-                abort.store(true);
+                abort_tasks();
                 wait();
 
                 // notify all threads to terminate
@@ -240,13 +519,7 @@ namespace threading {
                 std::cout << "destruct threads..." << std::endl;
 #endif
                 destruct.store(true);
-                for (unsigned int worker_index = 0; worker_index < thread_count; worker_index++) {
-                    std::lock_guard<std::mutex> worker_lock(mutexes[worker_index]);
-                    task_notifiers[worker_index].notify_all();
-#ifdef DEBUG
-                    std::cout << " > [" << worker_index << "] notified" << std::endl;
-#endif
-                }
+                idle.notify(thread_count);
 
 #ifdef DEBUG
                 std::cout << "join threads..." << std::endl;
@@ -254,107 +527,118 @@ namespace threading {
                 for (worker_t &worker: workers)
                     worker.thread.join();
                 workers.clear();
+
+                // note: all slots are back in the freelists once the tasks completed
+                for (unsigned int i = 0; i < thread_count; i++) {
+                    while (states[i].free_slots != nullptr) {
+                        task_slot *slot { states[i].free_slots };
+                        states[i].free_slots = slot->next;
+                        delete slot;
+                    }
+                }
+                while (shared_free_slots != nullptr) {
+                    task_slot *slot { shared_free_slots };
+                    shared_free_slots = slot->next;
+                    delete slot;
+                }
 #ifdef DEBUG
                 std::cout << "d'tor completed" << std::endl;
 #endif
             }
 
-            std::shared_ptr<task_t> add(const std::function<void (const std::function<bool (const std::shared_ptr<task_t> &)> &)> task) {
+            // Adds a task with a handle to its status, completing the group's part once executed or aborted
+            std::shared_ptr<task_t> add(const std::function<void (const std::function<bool (const std::shared_ptr<task_t> &)> &)> task, threading::task_group *group = nullptr) {
                 std::shared_ptr<task_t> temp = std::make_shared<task_t>(task_t{task_status::pending, task});
-
-                // TODO: only perform this if add() is called by thread_pool's internal threads
-                //~ if (active_threads.load() == threads.size()) {
-                    //~ // No pending threads, execute immediately in current thread
-                    //~ execute_task(*temp);
-                    //~ return temp;
-                //~ }
-
-                // TODO: begin with locating empty task queue, else perform logic below
-                unsigned int next_index = next_worker_index.fetch_add(1) % thread_count;
-                {
-                    std::lock_guard<std::mutex> worker_lock(mutexes[next_index]);
-                    task_queues[next_index].push(temp);
-                    task_notifiers[next_index].notify_one();
+                task_slot *slot = make_slot([this, temp] (const unsigned int worker_index, const bool aborted) {
+                    if (aborted) {
+                        temp->status = task_status::aborted;
+                        return;
+                    }
+                    try {
+                        temp->status = task_status::in_progress;
+                        temp->callback([this, worker_index] (const std::shared_ptr<task_t> &wait_for_task = nullptr) { return thread_yield(worker_index, wait_for_task); });
+                        temp->status = task_status::done;
 #ifdef DEBUG
-                    std::cout << "[" << next_index << "] task added" << std::endl;
+                        std::cout << "[" << worker_index << "] completed task" << std::endl;
 #endif
-                }
-
+                    }
+                    catch (...) {
+                        temp->status = task_status::failed;
+                    }
+                }, group);
+                submit(slot, 1, group);
                 return temp;
             }
-#if FALSE
-            // TODO: re-implement
-            std::vector<std::shared_ptr<task_t>> add(std::initializer_list<std::function<void (std::function<bool ()>)>> args) {
-                if (args.size() == 0)
-                    return 0;
-                if (args.size() == 1)
-                    return add(*args.begin());
-
-                std::vector<std::shared_ptr<task_t>> result;
-                {
-                    // TODO: don't lock for all these instructions!
-                    std::lock_guard<std::mutex> global_lock(mutex);
-                    for (auto task: args) {
-                        std::shared_ptr<task_t> temp = std::make_shared<task_t>();
-                        temp->callback = task;
-                        result.push_back(temp);
-                        task_queue.push(temp);
-                    }
+
+            // Adds a task without handle, neither the task nor callables up to task_slot::inline_size bytes are allocated once slots are recycled
+            template<typename F> void spawn(F &&task, threading::task_group *group = nullptr) {
+                submit(make_slot(unless_aborted(std::forward<F>(task)), group), 1, group);
+            }
+
+            // Adds the range of callables (moved from) as tasks without handle, queued at once
+            template<typename I> void spawn(I first, const I last, threading::task_group *group = nullptr) {
+                task_slot *slots {nullptr};
+                task_slot **tail {&slots};
+                std::size_t count {0};
+                for (; first != last; ++first, count++) {
+                    *tail = make_slot(unless_aborted(std::move(*first)), group);
+                    tail = &(*tail)->next;
                 }
-                task_notifier.notify_all();
-                return result;
+                if (count > 0)
+                    submit(slots, count, group);
             }
 
-            // TODO: re-implement
-            template<typename... T>
-            std::shared_ptr<task_t> add(const std::function<void (std::function<bool ()>)> &task, T... args) {
-                add(task);
-                return add(args...);
+            // Releases the creator's reference, the continuation runs right away if all tasks of the group completed already
+            void close_group(threading::task_group &group) {
+                release_group(&group);
+            }
+
+            // Pending and further added tasks are marked aborted instead of executed, running tasks are completed
+            void abort_tasks() {
+                abort.store(true);
+            }
+
+            bool is_aborted() const {
+                return abort.load();
             }
-#endif
 
             bool all_tasks_idle() {
-                for (unsigned int worker_index = 0; worker_index < thread_count; worker_index++) {
-                    if (is_worker_idle(worker_index)) {
-                        std::lock_guard<std::mutex> worker_lock(mutexes[worker_index]);
-                        if (task_queues[worker_index].size() == 0)
-                            continue;
-                    }
-                    return false;
-                }
-                return true;
+                // note: completed tasks are summed first, a task counted as completed was counted as added before
+                unsigned long completed {0};
+                for (unsigned int i = 0; i < thread_count; i++)
+                    completed += states[i].completed_tasks.load();
+                unsigned long added {0};
+                for (unsigned int i = 0; i < thread_count; i++)
+                    added += states[i].added_tasks.load();
+                return added == completed;
             }
 
             void wait() {
                 std::unique_lock<std::mutex> wait_lock(wait_mutex);
-                bool in_progress;
-                do {
-                    in_progress = !all_tasks_idle();
-                    if (in_progress)
-                        wait_notifier.wait(wait_lock);
-                } while (in_progress);
-
+                waiting_threads++;
+                wait_notifier.wait(wait_lock, [this] { return all_tasks_idle(); });
+                waiting_threads--;
                 wait_lock.unlock();
 #ifdef DEBUG
                 std::cout << "wait complete" << std::endl;
 #endif
             }
     };
-}
 
-std::ostream& operator<< (std::ostream& os, const threading::task_status &e) {
-    auto value = static_cast<std::underlying_type<threading::task_status>::type>(e);
-    std::string name {};
-    switch (e) {
-        case threading::task_status::pending: name = "pending"; break;
-        case threading::task_status::in_progress: name = "in_progress"; break;
-        case threading::task_status::done: name = "done"; break;
-        case threading::task_status::failed: name = "failed"; break;
-        case threading::task_status::aborted: name = "aborted"; break;
-        default: throw std::runtime_error("unhandled enum value: " + std::to_string(value));
+    std::ostream& operator<< (std::ostream& os, const threading::task_status &e) {
+        auto value = static_cast<std::underlying_type<threading::task_status>::type>(e);
+        std::string name {};
+        switch (e) {
+            case threading::task_status::pending: name = "pending"; break;
+            case threading::task_status::in_progress: name = "in_progress"; break;
+            case threading::task_status::done: name = "done"; break;
+            case threading::task_status::failed: name = "failed"; break;
+            case threading::task_status::aborted: name = "aborted"; break;
+            default: throw std::runtime_error("unhandled enum value: " + std::to_string(value));
+        }
+        os << "threading::" << name << "(" << value << ")";
+        return os;
     }
-    os << "threading::" << name << "(" << value << ")";
-    return os;
 }
 
 #endif //__THREAD_POOL_HPP_INCLUDED__
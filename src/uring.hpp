@@ -0,0 +1,192 @@
+#ifndef __URING_HPP_INCLUDED__
+#define __URING_HPP_INCLUDED__
+
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+#include <errno.h>
+#include <string.h> // strerror()
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h> // struct statx
+#include <sys/syscall.h> // SYS_io_uring_*
+#include <unistd.h>
+
+// Minimal io_uring interface (without liburing) used to batch statx() calls
+namespace uring {
+    class ring {
+        private:
+            int fd {-1};
+            unsigned int entries {0};
+            unsigned int queued {0}; // prepared but not yet submitted
+            unsigned int in_flight {0}; // submitted but not yet reaped
+
+            void *sq_ring {MAP_FAILED};
+            std::size_t sq_ring_size {0};
+            void *cq_ring {MAP_FAILED};
+            std::size_t cq_ring_size {0};
+            struct io_uring_sqe *sqes {static_cast<struct io_uring_sqe *>(MAP_FAILED)};
+            std::size_t sqes_size {0};
+
+            unsigned int *sq_tail {nullptr};
+            unsigned int *sq_mask {nullptr};
+            unsigned int *sq_array {nullptr};
+            unsigned int *cq_head {nullptr};
+            unsigned int *cq_tail {nullptr};
+            unsigned int *cq_mask {nullptr};
+            struct io_uring_cqe *cqes {nullptr};
+
+            template<typename T> static T *offset(void *base, const unsigned int bytes) {
+                return reinterpret_cast<T *>(static_cast<char *>(base) + bytes);
+            }
+
+            void release() {
+                if (sqes != MAP_FAILED)
+                    munmap(sqes, sqes_size);
+                if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+                    munmap(cq_ring, cq_ring_size);
+                if (sq_ring != MAP_FAILED)
+                    munmap(sq_ring, sq_ring_size);
+                if (fd != -1)
+                    close(fd);
+            }
+
+            bool is_supported(const unsigned char opcode) {
+                const std::size_t probe_size { sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op) };
+                std::unique_ptr<char[]> buffer(new char[probe_size]());
+                struct io_uring_probe *probe { reinterpret_cast<struct io_uring_probe *>(buffer.get()) };
+                if (syscall(SYS_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+                    return false;
+                return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+            }
+
+        public:
+            ring() = delete;
+            ring(const ring &) = delete;
+            ring &operator=(const ring &) = delete;
+
+            ring(const unsigned int entries_) {
+                struct io_uring_params params {};
+                fd = syscall(SYS_io_uring_setup, entries_, &params);
+                if (fd < 0)
+                    throw std::runtime_error("io_uring_setup() failed: " + std::string(strerror(errno)));
+                entries = params.sq_entries;
+
+                sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+                cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+                if (params.features & IORING_FEAT_SINGLE_MMAP)
+                    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+                sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+                if (sq_ring == MAP_FAILED) {
+                    release();
+                    throw std::runtime_error("Failed to map io_uring submission queue.");
+                }
+                if (params.features & IORING_FEAT_SINGLE_MMAP)
+                    cq_ring = sq_ring;
+                else
+                    cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+                sqes = static_cast<struct io_uring_sqe *>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+                if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+                    release();
+                    throw std::runtime_error("Failed to map io_uring completion queue.");
+                }
+
+                sq_tail = offset<unsigned int>(sq_ring, params.sq_off.tail);
+                sq_mask = offset<unsigned int>(sq_ring, params.sq_off.ring_mask);
+                sq_array = offset<unsigned int>(sq_ring, params.sq_off.array);
+                cq_head = offset<unsigned int>(cq_ring, params.cq_off.head);
+                cq_tail = offset<unsigned int>(cq_ring, params.cq_off.tail);
+                cq_mask = offset<unsigned int>(cq_ring, params.cq_off.ring_mask);
+                cqes = offset<struct io_uring_cqe>(cq_ring, params.cq_off.cqes);
+
+                if (!is_supported(IORING_OP_STATX)) {
+                    release();
+                    throw std::runtime_error("io_uring does not support statx.");
+                }
+            }
+
+            ~ring() {
+                release();
+            }
+
+            unsigned int capacity() const {
+                return entries;
+            }
+
+            unsigned int pending() const {
+                return queued + in_flight;
+            }
+
+            // Returns false if the submission queue is full
+            bool prepare_statx(const int dirfd, const char *path, const int flags, const unsigned int mask, struct statx *buffer, const unsigned long user_data) {
+                if (pending() >= entries)
+                    return false;
+
+                const unsigned int tail { *sq_tail };
+                const unsigned int index { tail & *sq_mask };
+                struct io_uring_sqe *sqe { &sqes[index] };
+                *sqe = {};
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = dirfd;
+                sqe->addr = reinterpret_cast<unsigned long>(path);
+                sqe->len = mask;
+                sqe->off = reinterpret_cast<unsigned long>(buffer);
+                sqe->statx_flags = flags;
+                sqe->user_data = user_data;
+                sq_array[index] = index;
+                __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+                queued++;
+                return true;
+            }
+
+            // Submit prepared entries and block until at least 'wait_count' completions are available
+            void submit(const unsigned int wait_count) {
+                const unsigned int wait { std::min(wait_count, pending()) };
+                while (true) {
+                    const long result { syscall(SYS_io_uring_enter, fd, queued, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0) };
+                    if (result >= 0) {
+                        queued -= result;
+                        in_flight += result;
+                        return;
+                    }
+                    if (errno != EINTR)
+                        throw std::runtime_error("io_uring_enter() failed: " + std::string(strerror(errno)));
+                }
+            }
+
+            // Hand available completions to callback(user_data, result), returns the number of completions
+            template<typename T> unsigned int reap(T callback) {
+                unsigned int count {0};
+                unsigned int head { *cq_head };
+                while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                    const struct io_uring_cqe &cqe { cqes[head & *cq_mask] };
+                    callback(static_cast<unsigned long>(cqe.user_data), cqe.res);
+                    head++;
+                    count++;
+                }
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+                in_flight -= count;
+                return count;
+            }
+    };
+
+    // Probes the kernel once whether io_uring with statx is usable
+    bool supported() {
+        static const bool result = [] {
+            try {
+                uring::ring probe(2);
+                return true;
+            }
+            catch (const std::runtime_error &) {
+                return false;
+            }
+        }();
+        return result;
+    }
+}
+
+#endif //__URING_HPP_INCLUDED__
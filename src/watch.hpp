@@ -0,0 +1,485 @@
+#ifndef __WATCH_HPP_INCLUDED__
+#define __WATCH_HPP_INCLUDED__
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h> // name_to_handle_at()
+#include <poll.h>
+#include <string.h> // strerror()
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/vfs.h> // fstatfs()
+#include <unistd.h>
+
+#include "fs.hpp"
+#include "node_tree.hpp"
+
+// Keeps a scanned node tree current from file system change events
+namespace watch {
+    enum class backend {
+        automatic, // fanotify if permitted, inotify otherwise
+        fanotify, // one mark per file system, requires CAP_SYS_ADMIN
+        inotify // one watch per directory
+    };
+
+    enum class change {
+        content, // entry modified, e.g. written to or truncated
+        structure // entry created, deleted or moved
+    };
+
+    /*
+        Kernel change notification of the watched directories. Events are
+        reported as the node of the directory and the name of the changed
+        entry within it.
+    */
+    class notifier {
+        private:
+            static constexpr unsigned long long fanotify_mask { FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB | FAN_ONDIR };
+            static constexpr unsigned int inotify_mask { IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_ATTRIB | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK };
+
+            const watch::backend requested;
+            int fd {-1};
+            watch::backend type {watch::backend::inotify};
+            int mark_error {0}; // errno of the last failed fanotify_mark()
+            std::unordered_map<int, fs::node_id> watch_nodes {}; // inotify watch descriptor to directory
+            std::unordered_map<std::string, fs::node_id> handle_nodes {}; // fanotify file system id and file handle to directory
+            std::set<std::string> marked_file_systems {};
+
+            static std::string handle_key(const fsid_t &fsid, const struct file_handle &handle) {
+                std::string key(reinterpret_cast<const char *>(&fsid), sizeof(fsid));
+                key.append(reinterpret_cast<const char *>(&handle.handle_type), sizeof(handle.handle_type));
+                key.append(reinterpret_cast<const char *>(handle.f_handle), handle.handle_bytes);
+                return key;
+            }
+
+            bool add_fanotify(const fs::directory &dir, const fs::node_id node) {
+                struct statfs sfs;
+                if (fstatfs(dir.descriptor(), &sfs) == -1)
+                    return false;
+                std::unique_ptr<char[]> buffer(new char[sizeof(struct file_handle) + MAX_HANDLE_SZ]);
+                struct file_handle *handle { reinterpret_cast<struct file_handle *>(buffer.get()) };
+                handle->handle_bytes = MAX_HANDLE_SZ;
+                int mount_id;
+                if (name_to_handle_at(dir.descriptor(), "", handle, &mount_id, AT_EMPTY_PATH) == -1)
+                    return false; // File system does not support file handles
+
+                const std::string file_system(reinterpret_cast<const char *>(&sfs.f_fsid), sizeof(sfs.f_fsid));
+                if (marked_file_systems.count(file_system) == 0) {
+                    if (fanotify_mark(fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, fanotify_mask, dir.descriptor(), nullptr) == -1) {
+                        mark_error = errno;
+                        return false;
+                    }
+                    marked_file_systems.insert(file_system);
+                }
+                handle_nodes[handle_key(sfs.f_fsid, *handle)] = node;
+                return true;
+            }
+
+            bool add_inotify(const fs::directory &dir, const fs::node_id node) {
+                const int wd { inotify_add_watch(fd, dir.path.c_str(), inotify_mask) };
+                if (wd == -1)
+                    return false; // e.g. fs.inotify.max_user_watches reached
+                watch_nodes[wd] = node;
+                return true;
+            }
+
+            template<typename T> bool read_fanotify(const char *buffer, long length, T callback) {
+                bool complete {true};
+                const struct fanotify_event_metadata *metadata { reinterpret_cast<const struct fanotify_event_metadata *>(buffer) };
+                for (; FAN_EVENT_OK(metadata, length); metadata = FAN_EVENT_NEXT(metadata, length)) {
+                    if (metadata->mask & FAN_Q_OVERFLOW) {
+                        complete = false;
+                        continue;
+                    }
+                    const struct fanotify_event_info_fid *info { reinterpret_cast<const struct fanotify_event_info_fid *>(reinterpret_cast<const char *>(metadata) + metadata->metadata_len) };
+                    if (metadata->event_len <= metadata->metadata_len || info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+                        continue;
+                    const struct file_handle *handle { reinterpret_cast<const struct file_handle *>(info->handle) };
+                    const char *name { reinterpret_cast<const char *>(handle->f_handle + handle->handle_bytes) };
+
+                    fsid_t fsid;
+                    memcpy(&fsid, &info->fsid, sizeof(fsid));
+                    const auto found = handle_nodes.find(handle_key(fsid, *handle));
+                    if (found == handle_nodes.end() || strcmp(name, ".") == 0)
+                        continue; // Outside of the watched tree or the directory itself
+                    callback(found->second, std::string_view(name), (metadata->mask & (FAN_MODIFY | FAN_ATTRIB)) && !(metadata->mask & (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO)) ? watch::change::content : watch::change::structure);
+                }
+                return complete;
+            }
+
+            template<typename T> bool read_inotify(const char *buffer, const long length, T callback) {
+                bool complete {true};
+                for (long offset = 0; offset < length;) {
+                    const struct inotify_event *event { reinterpret_cast<const struct inotify_event *>(buffer + offset) };
+                    offset += sizeof(struct inotify_event) + event->len;
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        complete = false;
+                        continue;
+                    }
+                    const auto found = watch_nodes.find(event->wd);
+                    if (found == watch_nodes.end())
+                        continue;
+                    if (event->mask & IN_IGNORED) {
+                        watch_nodes.erase(found); // Directory removed
+                        continue;
+                    }
+                    if (event->len == 0)
+                        continue;
+                    callback(found->second, std::string_view(event->name), (event->mask & (IN_MODIFY | IN_ATTRIB)) ? watch::change::content : watch::change::structure);
+                }
+                return complete;
+            }
+
+        public:
+            notifier() = delete;
+            notifier(const notifier &) = delete;
+            notifier &operator=(const notifier &) = delete;
+
+            notifier(const watch::backend requested_) : requested(requested_) {
+                if (requested != watch::backend::inotify) {
+                    fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY);
+                    type = watch::backend::fanotify;
+                    if (fd == -1 && requested == watch::backend::fanotify)
+                        throw std::runtime_error("fanotify_init() failed: " + std::string(strerror(errno)));
+                }
+                if (fd == -1) {
+                    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                    type = watch::backend::inotify;
+                    if (fd == -1)
+                        throw std::runtime_error("inotify_init1() failed: " + std::string(strerror(errno)));
+                }
+            }
+
+            ~notifier() {
+                close(fd);
+            }
+
+            watch::backend get_backend() const {
+                return type;
+            }
+
+            // Returns false if the directory cannot be watched
+            bool add(const fs::directory &dir, const fs::node_id node) {
+                return type == watch::backend::fanotify ? add_fanotify(dir, node) : add_inotify(dir, node);
+            }
+
+            /*
+                Whether a failed add() may succeed with inotify. Unprivileged
+                users may call fanotify_init() since Linux 5.13 but marking a
+                file system still requires CAP_SYS_ADMIN, some file systems
+                cannot be marked at all.
+            */
+            bool may_fall_back() const {
+                return requested == watch::backend::automatic && type == watch::backend::fanotify &&
+                    (mark_error == EPERM || mark_error == EOPNOTSUPP || mark_error == ENODEV || mark_error == EXDEV);
+            }
+
+            // Replaces fanotify by inotify, returns the directories added so far which need to be added again
+            std::vector<fs::node_id> fall_back() {
+                const int inotify_fd { inotify_init1(IN_NONBLOCK | IN_CLOEXEC) };
+                if (inotify_fd == -1)
+                    throw std::runtime_error("inotify_init1() failed: " + std::string(strerror(errno)));
+                close(fd);
+                fd = inotify_fd;
+                type = watch::backend::inotify;
+
+                std::vector<fs::node_id> nodes {};
+                for (const auto &[key, node]: handle_nodes)
+                    nodes.push_back(node);
+                handle_nodes.clear();
+                marked_file_systems.clear();
+                return nodes;
+            }
+
+            /*
+                Waits up to 'timeout_ms' for events and hands the pending ones
+                to callback(directory node, name, change). Returns false if
+                events were lost due to a queue overflow.
+            */
+            template<typename T> bool read(const int timeout_ms, T callback) {
+                struct pollfd pfd {fd, POLLIN, 0};
+                if (poll(&pfd, 1, timeout_ms) <= 0)
+                    return true;
+
+                alignas(struct fanotify_event_metadata) alignas(struct inotify_event) char buffer[64 * 1024];
+                bool complete {true};
+                while (true) {
+                    const long length { ::read(fd, buffer, sizeof(buffer)) };
+                    if (length <= 0)
+                        return complete; // EAGAIN, drained
+                    if (type == watch::backend::fanotify)
+                        complete &= read_fanotify(buffer, length, callback);
+                    else
+                        complete &= read_inotify(buffer, length, callback);
+                }
+            }
+    };
+
+    /*
+        Applies change events to the node tree of a completed scan. Changed
+        entries are stat'ed again and the length difference is added to their
+        ancestors, new directories are scanned. Removed nodes are kept with
+        fs::file_error::file_not_found and a length of zero, nodes created
+        after the scan are kept apart from the contiguous child ranges.
+    */
+    class tree_watcher {
+        private:
+            fs::node_tree &tree;
+            const fs::node_id root;
+            const unsigned int fields;
+            const fs::mount_policy *policy;
+            watch::notifier notifier;
+            unsigned long unwatched {0};
+
+            std::unordered_map<fs::node_id, std::vector<fs::node_id>> added_children {};
+            std::unordered_map<fs::node_id, std::unordered_map<std::string_view, fs::node_id>> name_indices {}; // built on first change within a directory
+
+            bool is_removed(const fs::node_id node) const {
+                return tree.arena(node).error(node) == fs::file_error::file_not_found;
+            }
+
+            // Whether the node or one of its ancestors was removed, e.g. a directory moved out of the tree
+            bool is_detached(fs::node_id node) const {
+                for (; node != fs::no_node; node = tree.arena(node).parent(node)) {
+                    if (is_removed(node))
+                        return true;
+                }
+                return false;
+            }
+
+            void watch_directory(const fs::directory &dir, const fs::node_id node) {
+                if (notifier.add(dir, node))
+                    return;
+                if (notifier.may_fall_back()) {
+                    // note: changes between the fanotify and inotify registration of a directory are not reported
+                    for (const fs::node_id watched: notifier.fall_back()) {
+                        if (is_detached(watched))
+                            continue;
+                        std::shared_ptr<fs::directory> watched_dir = fs::open_directory(tree.path(watched));
+                        if (watched_dir == nullptr || !notifier.add(*watched_dir, watched))
+                            unwatched++;
+                    }
+                    if (notifier.add(dir, node))
+                        return;
+                }
+                unwatched++;
+            }
+
+            // Registers the directories of the scanned tree
+            void watch_subtree(const fs::directory &dir, const fs::node_id node) {
+                watch_directory(dir, node);
+                for (const fs::node_id child: tree.children(node)) {
+                    if (tree.arena(child).type(child) != fs::file_type::directory)
+                        continue;
+                    if (policy != nullptr && !policy->may_enter(dir, tree.arena(child).name(child)))
+                        continue;
+                    std::shared_ptr<fs::directory> child_dir = fs::open_directory(dir, tree.arena(child).name(child));
+                    if (child_dir != nullptr && (policy == nullptr || policy->may_enter(*child_dir)))
+                        watch_subtree(*child_dir, child);
+                }
+            }
+
+            // Appends the contents of a directory created after the scan and watches its directories, returns their length
+            unsigned long scan_directory(const fs::directory &dir, const fs::node_id node) {
+                fs::file_error error {fs::file_error::none};
+                return fs::scan_subtree(tree, node, dir, fields, policy, nullptr, error, [this] (const fs::directory &subdir, const fs::node_id subnode) { watch_directory(subdir, subnode); });
+            }
+
+            std::unordered_map<std::string_view, fs::node_id> &name_index(const fs::node_id node) {
+                auto found = name_indices.find(node);
+                if (found != name_indices.end())
+                    return found->second;
+                std::unordered_map<std::string_view, fs::node_id> &index = name_indices[node];
+                for (const fs::node_id child: children(node))
+                    index[tree.arena(child).name(child)] = child;
+                return index;
+            }
+
+            void add_length(fs::node_id node, const long delta) {
+                for (; node != fs::no_node; node = tree.arena(node).parent(node))
+                    tree.arena(node).length(node) += delta;
+            }
+
+            // Stats the entry again, replaces its node on structural changes, returns the length difference
+            long refresh_entry(const fs::directory &dir, const fs::node_id node, const std::string &name, const watch::change type) {
+                std::unordered_map<std::string_view, fs::node_id> &index = name_index(node);
+                const auto found = index.find(name);
+                const fs::node_id old_child { found != index.end() ? found->second : fs::no_node };
+                const fs::file_info_t fi { fs::read_file(dir, name, fields) };
+
+                if (type == watch::change::content && old_child != fs::no_node && fi.error == fs::file_error::none && fi.type == tree.arena(old_child).type(old_child)) {
+                    if (fi.type == fs::file_type::directory)
+                        return 0; // Contents are reported by the directory's own events
+                    const long delta { static_cast<long>(fi.length) - static_cast<long>(tree.arena(old_child).length(old_child)) };
+                    tree.arena(old_child).set_stat(old_child, fi);
+                    return delta;
+                }
+
+                long delta {0};
+                if (old_child != fs::no_node) {
+                    delta -= tree.arena(old_child).length(old_child);
+                    tree.arena(old_child).length(old_child) = 0;
+                    tree.arena(old_child).error(old_child) = fs::file_error::file_not_found;
+                    index.erase(found);
+                }
+                if (fi.error == fs::file_error::file_not_found)
+                    return delta;
+
+                fs::node_arena &arena = tree.local_arena();
+                const fs::node_id new_child { arena.append(node, name, fi.type) };
+                fs::file_stat_t stat { fi };
+                if (fi.type == fs::file_type::directory && (policy == nullptr || policy->may_enter(dir, name))) {
+                    std::shared_ptr<fs::directory> child_dir = fs::open_directory(dir, name);
+                    if (child_dir != nullptr && (policy == nullptr || policy->may_enter(*child_dir)))
+                        stat.length += scan_directory(*child_dir, new_child);
+                }
+                arena.set_stat(new_child, stat);
+                added_children[node].push_back(new_child);
+                index[arena.name(new_child)] = new_child;
+                return delta + static_cast<long>(stat.length);
+            }
+
+            // Applies the changes of the entries of one directory
+            void refresh_directory(const fs::node_id node, const std::map<std::string, watch::change> &changes) {
+                if (is_detached(node))
+                    return;
+                std::shared_ptr<fs::directory> dir = fs::open_directory(tree.path(node));
+                if (dir == nullptr)
+                    return; // Removed, reported by the events of its parent
+
+                long delta {0};
+                bool structure {false};
+                for (const auto &entry: changes) {
+                    delta += refresh_entry(*dir, node, entry.first, entry.second);
+                    structure |= entry.second == watch::change::structure;
+                }
+                if (structure) {
+                    // The length of the directory itself may change along with its entries
+                    unsigned long contents_length {0};
+                    for (const fs::node_id child: children(node))
+                        contents_length += tree.arena(child).length(child);
+                    const unsigned long own_length { fs::read_file(*dir, fields).length };
+                    delta = static_cast<long>(own_length + contents_length) - static_cast<long>(tree.arena(node).length(node));
+                }
+                add_length(node, delta);
+            }
+
+            void remove_child(std::unordered_map<std::string_view, fs::node_id> &index, const fs::node_id child) {
+                tree.arena(child).length(child) = 0;
+                tree.arena(child).error(child) = fs::file_error::file_not_found;
+                index.erase(tree.arena(child).name(child));
+            }
+
+            // Reads the directory again, nodes of entries still present are updated in place, returns the length of its contents
+            unsigned long rescan_directory(const fs::directory &dir, const fs::node_id node) {
+                std::vector<std::string> names {};
+                fs::read_entries(dir, [&names] (const fs::dirent_t &dirent) {
+                    names.emplace_back(dirent.name);
+                });
+                std::unordered_map<std::string_view, fs::node_id> &index = name_index(node);
+                const std::unordered_set<std::string_view> listed(names.begin(), names.end());
+                for (const fs::node_id child: children(node)) {
+                    if (listed.count(tree.arena(child).name(child)) == 0)
+                        remove_child(index, child);
+                }
+
+                for (const auto &name: names) {
+                    const auto found = index.find(name);
+                    const fs::file_info_t fi { fs::read_file(dir, name, fields) };
+                    if (found == index.end() || fi.error != fs::file_error::none || fi.type != tree.arena(found->second).type(found->second)) {
+                        refresh_entry(dir, node, name, watch::change::structure); // note: new, removed meanwhile or replaced
+                        continue;
+                    }
+                    const fs::node_id child { found->second };
+                    fs::file_stat_t stat { fi };
+                    if (fi.type == fs::file_type::directory && (policy == nullptr || policy->may_enter(dir, name))) {
+                        std::shared_ptr<fs::directory> child_dir = fs::open_directory(dir, name);
+                        if (child_dir != nullptr && (policy == nullptr || policy->may_enter(*child_dir)))
+                            stat.length += rescan_directory(*child_dir, child);
+                    }
+                    tree.arena(child).set_stat(child, stat);
+                }
+
+                unsigned long length {0};
+                for (const fs::node_id child: children(node))
+                    length += tree.arena(child).length(child);
+                return length;
+            }
+
+        public:
+            tree_watcher() = delete;
+            tree_watcher(const tree_watcher &) = delete;
+            tree_watcher &operator=(const tree_watcher &) = delete;
+
+            tree_watcher(fs::node_tree &tree_, const fs::node_id root_, const unsigned int fields_, const fs::mount_policy *policy_, const watch::backend backend) : tree(tree_), root(root_), fields(fields_), policy(policy_), notifier(backend) {
+                std::shared_ptr<fs::directory> dir = fs::open_directory(tree.path(root));
+                if (dir == nullptr)
+                    throw std::runtime_error("Failed to open directory: " + tree.path(root));
+                watch_subtree(*dir, root);
+            }
+
+            watch::backend get_backend() const {
+                return notifier.get_backend();
+            }
+
+            // Directories which could not be watched, e.g. due to the inotify watch limit
+            unsigned long unwatched_directories() const {
+                return unwatched;
+            }
+
+            // Entries of the directory, including the ones created after the scan and excluding the removed ones
+            std::vector<fs::node_id> children(const fs::node_id node) const {
+                std::vector<fs::node_id> result {};
+                for (const fs::node_id child: tree.children(node)) {
+                    if (!is_removed(child))
+                        result.push_back(child);
+                }
+                const auto added = added_children.find(node);
+                if (added != added_children.end()) {
+                    for (const fs::node_id child: added->second) {
+                        if (!is_removed(child))
+                            result.push_back(child);
+                    }
+                }
+                return result;
+            }
+
+            // All events since the last update are lost, every entry of the tree is read again without appending the ones kept
+            void rescan() {
+                std::shared_ptr<fs::directory> dir = fs::open_directory(tree.path(root));
+                if (dir == nullptr)
+                    return;
+                const unsigned long contents_length { rescan_directory(*dir, root) };
+                tree.arena(root).length(root) = fs::read_file(*dir, fields).length + contents_length;
+            }
+
+            // Waits up to 'timeout_ms' for change events and applies them, returns true if any were applied
+            bool update(const int timeout_ms) {
+                std::map<fs::node_id, std::map<std::string, watch::change>> changes {};
+                const bool complete = notifier.read(timeout_ms, [&changes] (const fs::node_id node, const std::string_view &name, const watch::change type) {
+                    watch::change &entry = changes[node].emplace(std::string(name), type).first->second;
+                    if (type == watch::change::structure)
+                        entry = type;
+                });
+                if (!complete) {
+                    rescan();
+                    return true;
+                }
+
+                for (const auto &directory: changes)
+                    refresh_directory(directory.first, directory.second);
+                return changes.size() > 0;
+            }
+    };
+}
+
+#endif //__WATCH_HPP_INCLUDED__
@@ -0,0 +1,114 @@
+#ifndef __WORK_DEQUE_HPP_INCLUDED__
+#define __WORK_DEQUE_HPP_INCLUDED__
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace threading {
+    /*
+        Lock-free work-stealing deque of pointers (Chase-Lev, with the memory
+        orderings of Lê et al., "Correct and Efficient Work-Stealing for Weak
+        Memory Models"). Only the owning thread pushes and pops, at the
+        bottom (LIFO), any thread steals from the top (FIFO). The ring buffer
+        grows by doubling, replaced buffers are kept until destruction since
+        thieves may still read from them.
+    */
+    template<typename T>
+    class work_deque {
+        private:
+            struct buffer_t {
+                const long capacity; // power of two
+                std::unique_ptr<std::atomic<T *>[]> items;
+
+                buffer_t(const long capacity_) : capacity(capacity_), items(new std::atomic<T *>[capacity_]) {}
+
+                T *get(const long index) const { return items[index & (capacity - 1)].load(std::memory_order_relaxed); }
+                void put(const long index, T *item) { items[index & (capacity - 1)].store(item, std::memory_order_relaxed); }
+            };
+
+            alignas(64) std::atomic_long top {0};
+            alignas(64) std::atomic_long bottom {0};
+            std::atomic<buffer_t *> buffer {nullptr};
+            std::vector<std::unique_ptr<buffer_t>> buffers {}; // owner only
+
+            buffer_t *grow(const buffer_t *old_buffer, const long first, const long last) {
+                buffers.push_back(std::make_unique<buffer_t>(old_buffer->capacity * 2));
+                buffer_t *new_buffer { buffers.back().get() };
+                for (long i = first; i < last; i++)
+                    new_buffer->put(i, old_buffer->get(i));
+                buffer.store(new_buffer, std::memory_order_release);
+                return new_buffer;
+            }
+
+        public:
+            work_deque(const long capacity = 256) {
+                long power {1};
+                while (power < capacity)
+                    power *= 2;
+                buffers.push_back(std::make_unique<buffer_t>(power));
+                buffer.store(buffers.back().get(), std::memory_order_relaxed);
+            }
+
+            work_deque(const work_deque &) = delete;
+            work_deque &operator=(const work_deque &) = delete;
+
+            // Owner only
+            void push(T *item) {
+                const long last { bottom.load(std::memory_order_relaxed) };
+                const long first { top.load(std::memory_order_acquire) };
+                buffer_t *current { buffer.load(std::memory_order_relaxed) };
+                if (last - first > current->capacity - 1)
+                    current = grow(current, first, last);
+                current->put(last, item);
+                bottom.store(last + 1, std::memory_order_release); // note: rather than a release fence, equivalent here and understood by ThreadSanitizer
+            }
+
+            // Owner only, nullptr if empty
+            T *pop() {
+                const long last { bottom.load(std::memory_order_relaxed) - 1 };
+                buffer_t *current { buffer.load(std::memory_order_relaxed) };
+                bottom.store(last, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                long first { top.load(std::memory_order_relaxed) };
+                if (first > last) {
+                    bottom.store(last + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                T *item { current->get(last) };
+                if (first == last) {
+                    // Last item, raced against thieves
+                    if (!top.compare_exchange_strong(first, first + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        item = nullptr;
+                    bottom.store(last + 1, std::memory_order_relaxed);
+                }
+                return item;
+            }
+
+            // Any thread, nullptr if empty or lost against another thief or the owner
+            T *steal() {
+                long first { top.load(std::memory_order_acquire) };
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const long last { bottom.load(std::memory_order_acquire) };
+                if (first >= last)
+                    return nullptr;
+                T *item { buffer.load(std::memory_order_acquire)->get(first) };
+                if (!top.compare_exchange_strong(first, first + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    return nullptr;
+                return item;
+            }
+
+            // Approximate while other threads operate on the deque
+            long size() const {
+                const long last { bottom.load(std::memory_order_relaxed) };
+                const long first { top.load(std::memory_order_relaxed) };
+                return last > first ? last - first : 0;
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+    };
+}
+
+#endif //__WORK_DEQUE_HPP_INCLUDED__
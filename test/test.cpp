@@ -6,6 +6,14 @@
 #include "test_console.hpp"
 #include "test_fs.hpp"
 #include "test_thread_pool.hpp"
+#include "test_sharded_set.hpp"
+#include "test_work_deque.hpp"
+#include "test_node_tree.hpp"
+#include "test_watch.hpp"
+#include "test_snapshot.hpp"
+#include "test_sorting.hpp"
+#include "test_browser.hpp"
+#include "test_planning.hpp"
 
 int main(int argc, const char *argv[]) {
     bool verbose {false};
@@ -38,6 +46,46 @@ int main(int argc, const char *argv[]) {
     suite_thread_pool.execute();
     std::cout << suite_thread_pool.to_string(verbose) << std::endl;
 
-    return suite_unit.count_failure() + suite_console.count_failure() + suite_fs.count_failure() + suite_thread_pool.count_failure();
+    // sharded_set.hpp
+    unit::test_suite suite_sharded_set = get_suite_sharded_set();
+    suite_sharded_set.execute();
+    std::cout << suite_sharded_set.to_string(verbose) << std::endl;
+
+    // work_deque.hpp
+    unit::test_suite suite_work_deque = get_suite_work_deque();
+    suite_work_deque.execute();
+    std::cout << suite_work_deque.to_string(verbose) << std::endl;
+
+    // node_tree.hpp
+    unit::test_suite suite_node_tree = get_suite_node_tree();
+    suite_node_tree.execute();
+    std::cout << suite_node_tree.to_string(verbose) << std::endl;
+
+    // watch.hpp
+    unit::test_suite suite_watch = get_suite_watch();
+    suite_watch.execute();
+    std::cout << suite_watch.to_string(verbose) << std::endl;
+
+    // snapshot.hpp
+    unit::test_suite suite_snapshot = get_suite_snapshot();
+    suite_snapshot.execute();
+    std::cout << suite_snapshot.to_string(verbose) << std::endl;
+
+    // sorting.hpp
+    unit::test_suite suite_sorting = get_suite_sorting();
+    suite_sorting.execute();
+    std::cout << suite_sorting.to_string(verbose) << std::endl;
+
+    // browser.hpp
+    unit::test_suite suite_browser = get_suite_browser();
+    suite_browser.execute();
+    std::cout << suite_browser.to_string(verbose) << std::endl;
+
+    // planning.hpp
+    unit::test_suite suite_planning = get_suite_planning();
+    suite_planning.execute();
+    std::cout << suite_planning.to_string(verbose) << std::endl;
+
+    return suite_unit.count_failure() + suite_console.count_failure() + suite_fs.count_failure() + suite_thread_pool.count_failure() + suite_sharded_set.count_failure() + suite_work_deque.count_failure() + suite_node_tree.count_failure() + suite_watch.count_failure() + suite_snapshot.count_failure() + suite_sorting.count_failure() + suite_browser.count_failure() + suite_planning.count_failure();
 }
 
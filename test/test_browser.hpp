@@ -0,0 +1,46 @@
+#include "unit.hpp"
+#include "browser.hpp"
+
+void test_browser_rescan_graft() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("cd " + path + " && mkdir -p a/b c && printf 12345 > a/b/file && printf 678 > c/file");
+    const unsigned int fields { fs::file_field::field_type | fs::file_field::field_length };
+
+    // Rescanned into a tree of its own
+    fs::node_tree source;
+    const fs::node_id source_root { source.local_arena().append(fs::no_node, path, fs::file_type::directory) };
+    std::shared_ptr<fs::directory> dir = fs::open_directory(path);
+    fs::file_error error {fs::file_error::none};
+    const std::atomic_bool cancelled {false};
+    unsigned int directory_count {0};
+    const unsigned long length { fs::scan_subtree(source, source_root, *dir, fields, nullptr, &cancelled, error, [&directory_count] (const fs::directory &, const fs::node_id) { directory_count++; }) };
+    const unsigned long directory_length { fs::read_file(path + "/c", fs::file_field::field_length).length };
+    unit::assert_equals(3 * directory_length + 8, length, "scanned length");
+    unit::assert_true(error == fs::file_error::none, "no error");
+    unit::assert_equals(4u, directory_count, "directories handed to the hook");
+
+    // Grafted in place of the former contents
+    fs::node_tree tree;
+    fs::node_arena &arena = tree.local_arena();
+    const fs::node_id root { arena.append(fs::no_node, path, fs::file_type::directory) };
+    arena.set_children(root, arena.append(root, "removed", fs::file_type::file), 1);
+    browser::graft(tree, root, source, source_root);
+    const std::vector<fs::node_id> children { tree.children(root) };
+    unit::assert_equals(2u, children.size(), "number of grafted entries");
+    unsigned long grafted_length {0};
+    for (const fs::node_id child: children) {
+        grafted_length += arena.length(child);
+        unit::assert_true(std::string(arena.name(child)) != "removed", "former entry replaced");
+    }
+    unit::assert_equals(length, grafted_length, "grafted length");
+    const fs::node_id a { std::string(arena.name(children[0])) == "a" ? children[0] : children[1] };
+    unit::assert_equals(1u, arena.child_count(a), "nested entries grafted");
+    unit::assert_equals(path + "/a/b/file", tree.path(tree.children(tree.children(a).front()).front()), "path of grafted file");
+}
+
+unit::test_suite get_suite_browser() {
+    unit::test_suite suite("browser.hpp");
+    suite.add_test(test_browser_rescan_graft, "scan_subtree() and graft() of a rescan");
+    return suite;
+}
@@ -20,11 +20,11 @@ void verify_parse_args(std::vector<std::string> args, std::function<void (const
 
     for (unsigned int i = 0; i < args.size(); i++)
         free(c_args[i]);
-    free(c_args);
+    delete[] c_args;
 }
 
 bool compare_args(const console::arg_t &x, const console::arg_t &y) {
-    return x.key == y.key && x.value == y.value && x.next == y.next;
+    return x.key == y.key && x.value == y.value; // note: 'next' is verified by test_parse_args_linked()
 }
 
 void test_parse_args_none() {
@@ -65,6 +65,57 @@ void test_parse_args_long_variable() {
     });
 }
 
+void test_parse_args_linked() {
+    verify_parse_args({ "/tmp/test_console", "-x", "--foo=bar", "baz" }, [](const std::vector<console::arg_t> parsed) {
+        unit::assert_equals(3u, parsed.size(), "number of parsed arguments");
+        unit::assert_true(parsed[0].next != nullptr && parsed[0].next->key == "--foo", "first argument linked to second");
+        unit::assert_true(parsed[1].next != nullptr && parsed[1].next->key == "baz", "second argument linked to third");
+        unit::assert_true(parsed[2].next == nullptr, "last argument not linked");
+    });
+}
+
+void test_update_rows() {
+    std::stringstream first;
+    console::update_rows(first, {}, {"a", "b"});
+    unit::assert_equals("\x1b[2Ka\n\x1b[2Kb\n", first.str(), "rows written initially");
+
+    std::stringstream changed;
+    console::update_rows(changed, {"a", "b"}, {"a", "c", "d"});
+    unit::assert_equals("\x1b[2F\x1b[1E\x1b[2Kc\n\x1b[2Kd\n", changed.str(), "only changed and new rows written");
+
+    std::stringstream removed;
+    console::update_rows(removed, {"a", "b", "c"}, {"a"});
+    unit::assert_equals("\x1b[3F\x1b[1E\x1b[2K\n\x1b[2K\n\x1b[2F", removed.str(), "removed rows cleared, cursor below remaining rows");
+}
+
+void test_screen_render() {
+    console::screen screen(4, 2);
+    screen.write(0, 0, "ab", console::style::normal);
+    unit::assert_equals(ANSI_COLOR_FOREGROUND_RESET "\x1b[2J\x1b[1;1Hab  \x1b[2;1H    ", screen.render(), "complete redraw initially");
+    unit::assert_equals("", screen.render(), "nothing written if unchanged");
+
+    screen.clear();
+    screen.write(0, 0, "ab", console::style::normal);
+    screen.write(2, 1, "xyz", console::style::inverse);
+    unit::assert_equals("\x1b[2;3H\x1b[0;7mxy" ANSI_COLOR_FOREGROUND_RESET, screen.render(), "changed cells only, clipped at the end of the row");
+
+    screen.clear();
+    screen.write(0, 0, "\xc3\xa4" "b", console::style::normal);
+    unit::assert_equals("\x1b[1;1H" ANSI_COLOR_FOREGROUND_RESET "\xc3\xa4\x1b[2;3H  ", screen.render(), "multibyte character in a single cell");
+}
+
+void test_parse_key() {
+    const std::string input { "a\x1b[A\x1b[5~\r\x1b" };
+    std::size_t offset {0};
+    const console::key_event_t character { console::parse_key(input, offset) };
+    unit::assert_true(character.key == console::key::character && character.c == 'a', "character");
+    unit::assert_true(console::parse_key(input, offset).key == console::key::up, "cursor up");
+    unit::assert_true(console::parse_key(input, offset).key == console::key::page_up, "page up");
+    unit::assert_true(console::parse_key(input, offset).key == console::key::enter, "enter");
+    unit::assert_true(console::parse_key(input, offset).key == console::key::escape, "escape");
+    unit::assert_true(console::parse_key(input, offset).key == console::key::none, "end of input");
+}
+
 unit::test_suite get_suite_console() {
     unit::test_suite suite("console.hpp");
     suite.add_test(test_parse_args_none, "test_parse_args_none");
@@ -72,6 +123,10 @@ unit::test_suite get_suite_console() {
     suite.add_test(test_parse_args_short_multiple_flags, "test_parse_args_short_multiple_flags");
     suite.add_test(test_parse_args_dash, "test_parse_args_dash");
     suite.add_test(test_parse_args_long_variable, "test_parse_args_long_variable");
+    suite.add_test(test_parse_args_linked, "test_parse_args_linked");
+    suite.add_test(test_update_rows, "test_update_rows");
+    suite.add_test(test_screen_render, "test_screen_render");
+    suite.add_test(test_parse_key, "test_parse_key");
     return suite;
 }
 
@@ -1,6 +1,9 @@
 #include "unit.hpp"
 #include "fs.hpp"
 
+#include <fstream>
+#include <chrono>
+
 void test_dirname_null() {
     unit::assert_throws(std::exception(), []() { fs::dirname(nullptr); }, "dirname(nullptr)");
 }
@@ -49,6 +52,388 @@ void test_basename_no_ending_slash() {
     unit::assert_equals("bar", actual, "basename(\"/foo/bar\")");
 }
 
+// Directory below /tmp for the files of a test, removed with its contents once out of scope (also if an assertion failed)
+class test_directory {
+    public:
+        std::string path {""};
+
+        test_directory() {
+            char path_template[] = "/tmp/test_fs_XXXXXX";
+            if (mkdtemp(path_template) == nullptr)
+                throw std::runtime_error("failed to create test directory");
+            path = path_template;
+        }
+        test_directory(const test_directory &) = delete;
+        test_directory &operator=(const test_directory &) = delete;
+
+        ~test_directory() {
+            try {
+                exec("rm -rf " + path);
+            }
+            catch (const std::runtime_error &) {
+                // Left behind, the result of the test is reported anyway
+            }
+        }
+};
+
+void test_read_file_relative() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    std::ofstream(path + "/foo") << "12345";
+
+    std::shared_ptr<fs::directory> dir = fs::open_directory(path);
+    unit::assert_true(dir != nullptr, "open_directory(\"" + path + "\")");
+    fs::file_info_t expected = fs::read_file(path + "/foo");
+    fs::file_info_t actual = fs::read_file(*dir, "foo");
+
+    unit::assert_equals(expected.path, actual.path, "path of file");
+    unit::assert_equals(expected.name, actual.name, "name of file");
+    unit::assert_equals(5ul, actual.length, "length of file");
+    unit::assert_true(actual.type == fs::file_type::file, "type of file");
+}
+
+void test_read_file_fields() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    std::ofstream(path + "/foo") << "12345";
+
+    const unsigned int fields { fs::file_field::field_type | fs::file_field::field_length };
+    fs::file_info_t actual = fs::read_file(path + "/foo", fields);
+
+    unit::assert_true(actual.error == fs::file_error::none, "error of file");
+    unit::assert_equals(fields, actual.fields & fields, "requested fields are valid");
+    unit::assert_equals(5ul, actual.length, "length of file");
+    unit::assert_true(actual.type == fs::file_type::file, "type of file");
+}
+
+void test_read_directory_relative() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("mkdir -p " + path + "/a/b && printf 123 > " + path + "/a/b/c && printf 45 > " + path + "/d");
+
+    std::shared_ptr<fs::directory> dir = fs::open_directory(path);
+    unit::assert_true(dir != nullptr, "open_directory(\"" + path + "\")");
+    std::shared_ptr<fs::directory> child = fs::open_directory(*dir, "a");
+    unit::assert_true(child != nullptr, "open_directory(\"a\")");
+    unit::assert_equals(path + "/a", child->path, "path of child directory");
+
+    std::vector<fs::file_info_t> contents = fs::read_directory(*dir);
+
+    unit::assert_equals(2u, contents.size(), "number of entries");
+    for (const auto &fi: contents) {
+        unit::assert_equals(path, fi.path, "path of entry");
+        if (fi.name == "d")
+            unit::assert_equals(2ul, fi.length, "length of file");
+        else
+            unit::assert_equals(child->path, fi.path + '/' + fi.name, "directory listed");
+    }
+}
+
+void test_read_entries_large_directory() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("mkdir " + path + "/dir && cd " + path + " && seq -f 'file_%05g' 1 20000 | xargs touch");
+
+    std::shared_ptr<fs::directory> dir = fs::open_directory(path);
+    unit::assert_true(dir != nullptr, "open_directory(\"" + path + "\")");
+    unsigned int file_count {0};
+    unsigned int directory_count {0};
+    bool success = fs::read_entries(*dir, [&file_count, &directory_count] (const fs::dirent_t &entry) {
+        if (entry.name == "dir" && entry.type != fs::file_type::file)
+            directory_count++;
+        else if (entry.name.substr(0, 5) == "file_" && entry.type != fs::file_type::directory)
+            file_count++;
+    });
+
+    unit::assert_true(success, "read_entries() succeeded");
+    unit::assert_equals(20000u, file_count, "number of files");
+    unit::assert_equals(1u, directory_count, "number of directories");
+}
+
+void test_stat_files_uring() {
+    if (!uring::supported())
+        return; // Kernel lacks io_uring, synchronous path covered by other tests
+
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("mkdir " + path + "/dir && cd " + path + " && seq -f 'file_%05g' 1 1000 | xargs touch && printf 12345 > file_00042");
+
+    const unsigned int fields { fs::file_field::field_type | fs::file_field::field_length };
+    std::vector<fs::file_info_t> expected = fs::read_directory(path, fs::read_options_t{fields, fs::io_backend::sync});
+    std::vector<fs::file_info_t> actual = fs::read_directory(path, fs::read_options_t{fields, fs::io_backend::uring});
+
+    unit::assert_equals(expected.size(), actual.size(), "number of entries");
+    for (unsigned int i = 0; i < expected.size(); i++) {
+        unit::assert_equals(expected[i].name, actual[i].name, "name of entry");
+        unit::assert_equals(expected[i].length, actual[i].length, "length of entry");
+        unit::assert_true(expected[i].type == actual[i].type, "type of entry");
+        unit::assert_true(actual[i].error == fs::file_error::none, "error of entry");
+    }
+}
+
+void test_stat_files_inode_order() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("mkdir " + path + "/dir && cd " + path + " && seq -f 'file_%05g' 1 1000 | xargs touch && printf 12345 > file_00042");
+
+    const unsigned int fields { fs::file_field::field_type | fs::file_field::field_length | fs::file_field::field_links };
+    std::vector<fs::file_info_t> expected = fs::read_directory(path, fs::read_options_t{fields, fs::io_backend::sync, fs::stat_order::readdir});
+    std::vector<fs::file_info_t> actual = fs::read_directory(path, fs::read_options_t{fields, fs::io_backend::sync, fs::stat_order::inode});
+
+    unit::assert_equals(expected.size(), actual.size(), "number of entries");
+    for (unsigned int i = 0; i < expected.size(); i++) {
+        unit::assert_equals(expected[i].name, actual[i].name, "entries keep listing order");
+        unit::assert_equals(expected[i].length, actual[i].length, "length of entry");
+        unit::assert_equals(expected[i].inode, actual[i].inode, "inode of entry");
+        unit::assert_true(expected[i].type == actual[i].type, "type of entry");
+    }
+}
+
+void test_charge_once_hard_links() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("cd " + path + " && printf 12345 > a && ln a b && ln a c && printf 678 > d");
+
+    const unsigned int fields { fs::file_field::field_type | fs::file_field::field_length | fs::file_field::field_links };
+    std::vector<fs::file_info_t> contents { fs::read_directory(path, fs::read_options_t{fields}) };
+    std::vector<fs::file_stat_t *> files {};
+    for (auto &fi: contents)
+        files.push_back(&fi);
+    fs::link_accounting_t accounting {};
+    fs::charge_once(files, accounting);
+    unsigned long length {0};
+    for (const auto &fi: contents)
+        length += fi.length;
+
+    unit::assert_equals(8ul, length, "charged length");
+    unit::assert_equals(18ul, accounting.apparent_length.load(), "apparent length");
+}
+
+void test_read_mounts() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    std::ofstream(path + "/mountinfo")
+        << "22 1 8:1 / / rw,relatime shared:1 - ext4 /dev/sda1 rw" << std::endl
+        << "23 22 0:21 / /proc rw,nosuid shared:12 - proc proc rw" << std::endl
+        << "24 22 0:45 / /mnt/with\\040space rw master:3 - nfs4 server:/export rw" << std::endl;
+
+    std::vector<fs::mount_t> mounts = fs::read_mounts(path + "/mountinfo");
+
+    unit::assert_equals(3u, mounts.size(), "number of mounts");
+    unit::assert_equals("/proc", mounts[1].path, "path of mount");
+    unit::assert_equals("proc", mounts[1].type, "type of mount");
+    unit::assert_equals(makedev(0, 21), mounts[1].device, "device of mount");
+    unit::assert_equals("/mnt/with space", mounts[2].path, "unescaped path of mount");
+    unit::assert_equals("nfs4", mounts[2].type, "type of mount after optional fields");
+}
+
+void test_mount_policy() {
+    std::shared_ptr<fs::directory> root = fs::open_directory("/");
+    unit::assert_true(root != nullptr, "open_directory(\"/\")");
+    const std::vector<fs::mount_t> mounts {
+        fs::mount_t{root->root_device, "/", "ext4"},
+        fs::mount_t{makedev(0, 21), "/proc", "proc"},
+        fs::mount_t{makedev(0, 22), "/data", "xfs"},
+        fs::mount_t{root->root_device, "/bind", "ext4"}
+    };
+
+    fs::mount_policy skip_pseudo(mounts, false, true);
+    unit::assert_false(skip_pseudo.may_enter(*root, "proc"), "pseudo file system skipped");
+    unit::assert_true(skip_pseudo.may_enter(*root, "data"), "other file system entered");
+    unit::assert_true(skip_pseudo.may_enter(*root, "usr"), "directory entered");
+
+    fs::mount_policy one_file_system(mounts, true, false);
+    unit::assert_false(one_file_system.may_enter(*root, "proc"), "pseudo file system on other device skipped");
+    unit::assert_false(one_file_system.may_enter(*root, "data"), "other device skipped");
+    unit::assert_true(one_file_system.may_enter(*root, "bind"), "same device entered");
+    unit::assert_true(one_file_system.may_enter(*root), "target itself entered");
+}
+
+// Lists the tree through the cache and records the listings, returns the length of the entries below the directory
+unsigned long scan_length(const fs::directory &dir, fs::scan_cache &cache) {
+    std::vector<std::pair<ino64_t, std::string>> entries {};
+    fs::directory_stamp_t stamp {};
+    if (!cache.read_entries(dir, stamp, [&entries] (const fs::dirent_t &dirent) { entries.emplace_back(dirent.inode, std::string(dirent.name)); }))
+        return 0;
+
+    unsigned long length {0};
+    std::vector<fs::dirent_t> listing {};
+    for (const auto &[inode, name]: entries) {
+        const fs::file_info_t fi { fs::read_file(dir, name, fs::file_field::field_type | fs::file_field::field_length) };
+        listing.push_back(fs::dirent_t{inode, fi.type, name});
+        length += fi.length;
+        if (fi.type != fs::file_type::directory)
+            continue;
+        std::shared_ptr<fs::directory> child = fs::open_directory(dir, name);
+        if (child != nullptr)
+            length += scan_length(*child, cache);
+    }
+    cache.record(stamp, listing);
+    return length;
+}
+
+unsigned long scan_length(const std::string &path, fs::scan_cache &cache) {
+    std::shared_ptr<fs::directory> dir = fs::open_directory(path);
+    const unsigned long length { dir != nullptr ? scan_length(*dir, cache) : 0 };
+    cache.save();
+    return length;
+}
+
+void test_scan_cache_invalidation() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("cd " + path + " && mkdir tree tree/a tree/b && printf 12345 > tree/a/file && printf 678 > tree/b/file");
+
+    unsigned long cold_length {0};
+    {
+        fs::scan_cache cache(path + "/cache", 0);
+        cold_length = scan_length(path + "/tree", cache);
+        unit::assert_equals(3ul, cache.misses.load(), "cold scan misses");
+    }
+    unsigned long warm_length {0};
+    {
+        fs::scan_cache cache(path + "/cache", 0);
+        warm_length = scan_length(path + "/tree", cache);
+        unit::assert_equals(3ul, cache.hits.load(), "warm scan hits");
+    }
+    exec("printf 9 > " + path + "/tree/b/other && printf 123456789 > " + path + "/tree/a/file");
+    unsigned long changed_length {0};
+    {
+        fs::scan_cache cache(path + "/cache", 0);
+        changed_length = scan_length(path + "/tree", cache);
+        unit::assert_equals(2ul, cache.hits.load(), "changed scan hits");
+        unit::assert_equals(1ul, cache.misses.load(), "changed scan misses");
+    }
+
+    unit::assert_equals(cold_length, warm_length, "warm scan length");
+    unit::assert_equals(cold_length + 5, changed_length, "changed scan length");
+}
+
+void test_scan_cache_racy_directories() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("mkdir " + path + "/tree && touch " + path + "/tree/file");
+
+    {
+        fs::scan_cache cache(path + "/cache");
+        scan_length(path + "/tree", cache);
+    }
+    fs::scan_cache cache(path + "/cache");
+    scan_length(path + "/tree", cache);
+
+    unit::assert_equals(0ul, cache.hits.load(), "recently changed directory not cached");
+}
+
+void test_propagate_error() {
+    fs::file_error error { fs::file_error::none };
+    fs::propagate_error(error, fs::file_error::file_not_found);
+    unit::assert_true(error == fs::file_error::none, "errors of entries other than permission denied not propagated");
+    fs::propagate_error(error, fs::file_error::permission_denied);
+    unit::assert_true(error == fs::file_error::permission_denied, "permission denied propagated");
+    fs::propagate_error(error, fs::file_error::incomplete);
+    unit::assert_true(error == fs::file_error::incomplete, "incomplete propagated");
+    fs::propagate_error(error, fs::file_error::permission_denied);
+    unit::assert_true(error == fs::file_error::incomplete, "incomplete takes precedence over permission denied");
+}
+
+void test_scan_cache_invalid_file() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("mkdir " + path + "/tree && printf 12345 > " + path + "/tree/file && head -c 4096 /dev/urandom > " + path + "/cache");
+
+    fs::scan_cache cache(path + "/cache", 0);
+    const unsigned long length { scan_length(path + "/tree", cache) };
+
+    unit::assert_equals(5ul, length, "length read from file system");
+    unit::assert_equals(0ul, cache.hits.load(), "invalid cache ignored");
+}
+
+// Drops the dentry and inode caches of the whole system, only if opted in by DUS_TEST_DROP_CACHES=1 (requires root)
+bool drop_dentry_cache() {
+    const char *opt_in { getenv("DUS_TEST_DROP_CACHES") };
+    if (opt_in == nullptr || std::string(opt_in) != "1")
+        return false;
+    sync();
+    std::ofstream drop_caches("/proc/sys/vm/drop_caches");
+    drop_caches << "2" << std::endl;
+    return drop_caches.good();
+}
+
+void performance_stat_backends() {
+    std::cout << "performance stat backends" << std::endl;
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("cd " + path + " && for d in $(seq 1 20); do mkdir $d && (cd $d && seq 1 500 | xargs touch); done");
+
+    const unsigned int fields { fs::file_field::field_type | fs::file_field::field_length };
+    const std::vector<std::pair<std::string, std::function<unsigned long (void)>>> backends {
+        {"lstat() loop", [&path] () {
+            unsigned long length {0};
+            for (unsigned int d = 1; d <= 20; d++) {
+                const std::string directory = path + '/' + std::to_string(d);
+                DIR *dp = opendir(directory.c_str());
+                struct dirent *dirp {nullptr};
+                while ((dirp = readdir(dp)) != nullptr) {
+                    struct stat sb;
+                    if (lstat((directory + '/' + dirp->d_name).c_str(), &sb) == 0)
+                        length += sb.st_size;
+                }
+                closedir(dp);
+            }
+            return length;
+        }},
+        {"statx() sync", [&path, fields] () {
+            unsigned long length {0};
+            for (unsigned int d = 1; d <= 20; d++)
+                for (const auto &fi: fs::read_directory(path + '/' + std::to_string(d), fs::read_options_t{fields, fs::io_backend::sync}))
+                    length += fi.length;
+            return length;
+        }},
+        {"statx() io_uring", [&path, fields] () {
+            unsigned long length {0};
+            for (unsigned int d = 1; d <= 20; d++)
+                for (const auto &fi: fs::read_directory(path + '/' + std::to_string(d), fs::read_options_t{fields, fs::io_backend::uring}))
+                    length += fi.length;
+            return length;
+        }}
+    };
+
+    for (const auto &backend: backends) {
+        std::string cold {"skipped (requires DUS_TEST_DROP_CACHES=1 and root)"};
+        if (drop_dentry_cache()) {
+            const auto start_time = std::chrono::high_resolution_clock::now();
+            backend.second();
+            std::chrono::duration<double, std::milli> elapsed_time = std::chrono::high_resolution_clock::now() - start_time;
+            cold = std::to_string(elapsed_time.count()) + "ms";
+        }
+
+        backend.second(); // populate caches
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        backend.second();
+        std::chrono::duration<double, std::milli> elapsed_time = std::chrono::high_resolution_clock::now() - start_time;
+        std::cout << " - " << backend.first << ": cold " << cold << " - warm " << elapsed_time.count() << "ms" << std::endl;
+    }
+}
+
+void performance_scan_cache() {
+    std::cout << "performance scan cache" << std::endl;
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("cd " + path + " && mkdir tree && cd tree && for d in $(seq 1 100); do mkdir $d && (cd $d && seq 1 200 | xargs touch); done");
+
+    const auto measure = [&path] (const std::string &name) {
+        fs::scan_cache cache(path + "/cache", 0);
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        scan_length(path + "/tree", cache);
+        std::chrono::duration<double, std::milli> elapsed_time = std::chrono::high_resolution_clock::now() - start_time;
+        std::cout << " - " << name << ": " << elapsed_time.count() << "ms (" << cache.hits.load() << " hits, " << cache.misses.load() << " misses)" << std::endl;
+    };
+    measure("cold scan");
+    measure("warm scan, unchanged");
+    exec("cd " + path + "/tree/42 && seq 201 400 | xargs touch"); // 1% of the entries in 1% of the directories
+    measure("warm scan, 1% changed");
+}
+
 unit::test_suite get_suite_fs() {
     unit::test_suite suite("fs.hpp");
     suite.add_test(test_dirname_null, "");
@@ -59,6 +444,23 @@ unit::test_suite get_suite_fs() {
     suite.add_test(test_basename_empty_string, "");
     suite.add_test(test_basename_ending_slash, "");
     suite.add_test(test_basename_no_ending_slash, "");
+    suite.add_test(test_read_file_relative, "read_file() relative to directory handle");
+    suite.add_test(test_read_file_fields, "read_file() with minimal field mask");
+    suite.add_test(test_read_directory_relative, "read_directory() relative to directory handle");
+    suite.add_test(test_propagate_error, "propagate_error() keeps the most relevant error of the entries");
+    suite.add_test(test_read_entries_large_directory, "read_entries() of directory larger than initial buffer");
+    suite.add_test(test_stat_files_uring, "stat_files() through io_uring equals synchronous stat");
+    suite.add_test(test_stat_files_inode_order, "stat_files() in inode order equals listing order");
+    suite.add_test(test_charge_once_hard_links, "hard linked files are charged once");
+    suite.add_test(test_read_mounts, "read_mounts() parses mountinfo");
+    suite.add_test(test_mount_policy, "mount_policy decides on mount points by path and device");
+
+    suite.add_test(test_scan_cache_invalidation, "scan_cache reuses listings of unchanged directories only");
+    suite.add_test(test_scan_cache_racy_directories, "scan_cache skips recently changed directories");
+    suite.add_test(test_scan_cache_invalid_file, "scan_cache ignores invalid cache file");
+
+    suite.add_test(performance_stat_backends, "");
+    suite.add_test(performance_scan_cache, "");
     return suite;
 }
 
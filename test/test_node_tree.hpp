@@ -0,0 +1,100 @@
+#include "unit.hpp"
+#include "node_tree.hpp"
+
+#include <thread>
+#include <chrono>
+
+void test_node_paths() {
+    fs::node_tree tree;
+    fs::node_arena &arena = tree.local_arena();
+    const fs::node_id root { arena.append(fs::no_node, "/tmp", fs::file_type::directory) };
+    const fs::node_id first { arena.append(root, "foo", fs::file_type::directory) };
+    arena.append(root, "bar", fs::file_type::file);
+    const fs::node_id grandchild { arena.append(first, "baz", fs::file_type::file) };
+    arena.set_children(root, first, 2);
+    arena.set_children(first, grandchild, 1);
+
+    unit::assert_equals("/tmp/foo/baz", tree.path(grandchild), "path of grandchild");
+    unit::assert_equals(2u, tree.children(root).size(), "number of children");
+    unit::assert_equals("bar", std::string(arena.name(tree.children(root)[1])), "name of second child");
+
+    const fs::file_info_t fi { tree.to_file_info(grandchild) };
+    unit::assert_equals("/tmp/foo", fi.path, "path of file info");
+    unit::assert_equals("baz", fi.name, "name of file info");
+    unit::assert_true(fi.type == fs::file_type::file, "type of file info");
+}
+
+void test_sum_lengths_across_chunks() {
+    fs::node_tree tree;
+    fs::node_arena &arena = tree.local_arena();
+    const fs::node_id root { arena.append(fs::no_node, "/", fs::file_type::directory) };
+    const std::size_t node_count { fs::node_arena::chunk_size * 2 + 10 };
+    const fs::node_id first { arena.append(root, "0", fs::file_type::file) };
+    arena.length(first) = 1;
+    for (std::size_t i = 1; i < node_count; i++)
+        arena.length(arena.append(root, std::to_string(i), fs::file_type::file)) = i + 1;
+
+    unit::assert_equals(node_count * (node_count + 1) / 2, arena.sum_lengths(first, node_count), "sum of all lengths");
+    unit::assert_equals(node_count + 1, tree.size(), "number of nodes");
+    unit::assert_equals(std::to_string(node_count - 1), std::string(arena.name(first + node_count - 1)), "interned name in last chunk");
+}
+
+void test_arena_per_thread() {
+    fs::node_tree tree;
+    fs::node_arena *arenas[2] {nullptr, nullptr};
+    std::thread first([&tree, &arenas] () { arenas[0] = &tree.local_arena(); });
+    std::thread second([&tree, &arenas] () { arenas[1] = &tree.local_arena(); });
+    first.join();
+    second.join();
+
+    unit::assert_true(arenas[0] != arenas[1], "threads use arenas of their own");
+    unit::assert_true(&tree.local_arena() == &tree.local_arena(), "thread reuses its arena");
+    fs::node_tree other;
+    unit::assert_true(&other.local_arena() != &tree.local_arena(), "trees use arenas of their own");
+}
+
+void performance_node_storage() {
+    std::cout << "performance node storage" << std::endl;
+    const unsigned int node_count {1000000};
+    const std::string path {"/some/directory/with/a/long/path"};
+
+    const auto file_info_start = std::chrono::high_resolution_clock::now();
+    {
+        std::vector<fs::file_info_t> files;
+        for (unsigned int i = 0; i < node_count; i++) {
+            fs::file_info_t fi {};
+            fi.path = path;
+            fi.name = "file_name_" + std::to_string(i);
+            fi.length = i;
+            files.push_back(std::move(fi));
+        }
+        unsigned long length {0};
+        for (const auto &fi: files)
+            length += fi.length;
+        unit::assert_equals(static_cast<unsigned long>(node_count) * (node_count - 1) / 2, length, "sum of file info lengths");
+    }
+    std::chrono::duration<double, std::milli> file_info_time = std::chrono::high_resolution_clock::now() - file_info_start;
+
+    const auto node_start = std::chrono::high_resolution_clock::now();
+    {
+        fs::node_tree tree;
+        fs::node_arena &arena = tree.local_arena();
+        const fs::node_id root { arena.append(fs::no_node, path, fs::file_type::directory) };
+        for (unsigned int i = 0; i < node_count; i++)
+            arena.length(arena.append(root, "file_name_" + std::to_string(i), fs::file_type::file)) = i;
+        unit::assert_equals(static_cast<unsigned long>(node_count) * (node_count - 1) / 2, arena.sum_lengths(root + 1, node_count), "sum of node lengths");
+    }
+    std::chrono::duration<double, std::milli> node_time = std::chrono::high_resolution_clock::now() - node_start;
+
+    std::cout << " - file_info_t: " << file_info_time.count() << "ms - node_arena: " << node_time.count() << "ms (" << node_count << " entries)" << std::endl;
+}
+
+unit::test_suite get_suite_node_tree() {
+    unit::test_suite suite("node_tree.hpp");
+    suite.add_test(test_node_paths, "paths are rebuilt from parent nodes");
+    suite.add_test(test_sum_lengths_across_chunks, "sum_lengths() over range spanning chunks");
+    suite.add_test(test_arena_per_thread, "local_arena() per thread and tree");
+
+    suite.add_test(performance_node_storage, "");
+    return suite;
+}
@@ -0,0 +1,82 @@
+#include "unit.hpp"
+#include "planning.hpp"
+
+std::vector<std::size_t> collect_roots(const std::vector<planning::target_plan_t> &plan, const std::vector<bool> &resolved) {
+    std::vector<std::size_t> roots {};
+    planning::collect_plan_roots(plan, 0, resolved, roots);
+    return roots;
+}
+
+void test_plan_nested_targets() {
+    std::vector<planning::target_plan_t> plan {};
+    const std::size_t outer { planning::add_plan_target(plan, "/data", 0) };
+    const std::size_t nested { planning::add_plan_target(plan, "/data/a/b", 1) };
+    unit::assert_equals(1ul, plan[0].children.size(), "one child of /");
+    unit::assert_equals(outer, plan[0].children.at("data"), "node of /data");
+    unit::assert_equals(nested, plan[plan[outer].children.at("a")].children.at("b"), "node of /data/a/b");
+
+    const std::vector<std::size_t> roots { collect_roots(plan, {false, false}) };
+    unit::assert_equals(1ul, roots.size(), "only the outer target is parsed");
+    unit::assert_equals(0ul, roots.front(), "outer target parsed");
+}
+
+void test_plan_duplicate_targets() {
+    std::vector<planning::target_plan_t> plan {};
+    const std::size_t first { planning::add_plan_target(plan, "/data", 0) };
+    const std::size_t second { planning::add_plan_target(plan, "/data/", 1) }; // note: canonical paths of both, e.g. through a symlink
+    unit::assert_equals(first, second, "same node for the same path");
+    unit::assert_equals(2ul, plan[first].targets.size(), "both targets at the node");
+
+    const std::vector<std::size_t> roots { collect_roots(plan, {false, false}) };
+    unit::assert_equals(1ul, roots.size(), "directory parsed once");
+    unit::assert_equals(0ul, roots.front(), "first target parsed");
+}
+
+void test_plan_unreachable_nested_target() {
+    // The nested target lies below an excluded mount point, it is not resolved by parsing the outer one
+    std::vector<planning::target_plan_t> plan {};
+    planning::add_plan_target(plan, "/data", 0);
+    planning::add_plan_target(plan, "/data/mnt/b", 1);
+    planning::add_plan_target(plan, "/data/c", 2);
+    const std::vector<std::size_t> first_round { collect_roots(plan, {false, false, false}) };
+    unit::assert_equals(1ul, first_round.size(), "first round parses the outer target");
+
+    const std::vector<std::size_t> second_round { collect_roots(plan, {true, false, true}) };
+    unit::assert_equals(1ul, second_round.size(), "second round parses the unreached target");
+    unit::assert_equals(1ul, second_round.front(), "unreached target parsed on its own");
+    unit::assert_equals(0ul, collect_roots(plan, {true, true, true}).size(), "all targets resolved");
+}
+
+void test_plan_sibling_prefixes() {
+    std::vector<planning::target_plan_t> plan {};
+    const std::size_t data { planning::add_plan_target(plan, "/data", 0) };
+    const std::size_t data2 { planning::add_plan_target(plan, "/data2", 1) };
+    unit::assert_true(data != data2, "distinct nodes for /data and /data2");
+    unit::assert_equals(2ul, plan[0].children.size(), "siblings below /");
+
+    const std::vector<std::size_t> roots { collect_roots(plan, {false, false}) };
+    unit::assert_equals(2ul, roots.size(), "both targets parsed");
+}
+
+void test_plan_root_length() {
+    // -u: '/nt' and '/nt/a' (nested, no root of its own) and a duplicate of '/nt'
+    std::vector<fs::file_info_t> targets(3);
+    targets[0].length = 68480;
+    targets[1].length = 43192;
+    targets[2].length = 68480;
+    const std::vector<fs::node_id> roots { 1, fs::no_node, fs::no_node };
+    unit::assert_equals(68480ul, planning::root_length(targets, roots), "nested and duplicate targets counted once");
+
+    const std::vector<fs::node_id> disjoint { 1, 2, fs::no_node };
+    unit::assert_equals(111672ul, planning::root_length(targets, disjoint), "targets parsed on their own (e.g. below an excluded mount point)");
+}
+
+unit::test_suite get_suite_planning() {
+    unit::test_suite suite("planning.hpp");
+    suite.add_test(test_plan_nested_targets, "nested targets are resolved by the outer one");
+    suite.add_test(test_plan_duplicate_targets, "duplicate canonical paths share a node");
+    suite.add_test(test_plan_unreachable_nested_target, "nested targets not reached are parsed in the next round");
+    suite.add_test(test_plan_sibling_prefixes, "sibling paths sharing a prefix are not nested");
+    suite.add_test(test_plan_root_length, "root_length() of -u counts nested targets once");
+    return suite;
+}
@@ -0,0 +1,44 @@
+#include "unit.hpp"
+#include "sharded_set.hpp"
+
+#include <thread>
+#include <atomic>
+
+void test_insert_unique() {
+    threading::sharded_set<unsigned int> set;
+    unit::assert_true(set.insert(42), "first insert of value");
+    unit::assert_false(set.insert(42), "second insert of value");
+    unit::assert_true(set.contains(42), "contains inserted value");
+    unit::assert_false(set.contains(43), "contains other value");
+    unit::assert_equals(1u, set.size(), "size of set");
+}
+
+void test_concurrent_insert() {
+    const unsigned int thread_count {8};
+    const unsigned int value_count {10000};
+    threading::sharded_set<unsigned int> set;
+    std::atomic_uint inserted {0};
+
+    // every thread inserts the same values, each value must be reported as new exactly once
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < thread_count; t++) {
+        threads.emplace_back([&set, &inserted, t] () {
+            for (unsigned int i = 0; i < value_count; i++) {
+                if (set.insert((i + t * 997) % value_count))
+                    inserted++;
+            }
+        });
+    }
+    for (auto &thread: threads)
+        thread.join();
+
+    unit::assert_equals(value_count, inserted.load(), "number of values reported as new");
+    unit::assert_equals(value_count, set.size(), "size of set");
+}
+
+unit::test_suite get_suite_sharded_set() {
+    unit::test_suite suite("sharded_set.hpp");
+    suite.add_test(test_insert_unique, "insert() reports whether value is new");
+    suite.add_test(test_concurrent_insert, "concurrent insert() of overlapping values");
+    return suite;
+}
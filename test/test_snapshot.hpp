@@ -0,0 +1,166 @@
+#include "unit.hpp"
+#include "snapshot.hpp"
+
+#include <chrono>
+
+#include <stdlib.h> // mkstemp()
+
+std::string create_snapshot_path() {
+    char path_template[] = "/tmp/test_snapshot_XXXXXX";
+    const int fd { mkstemp(path_template) };
+    if (fd == -1)
+        throw std::runtime_error("failed to create snapshot file");
+    close(fd);
+    return std::string(path_template);
+}
+
+// Tree of "/data" with directories "a" (files "x", "y") and "b" (file "z"), the lengths of the files as given
+fs::node_id create_snapshot_tree(fs::node_tree &tree, const unsigned long x, const unsigned long y, const unsigned long z) {
+    fs::node_arena &arena = tree.local_arena();
+    const fs::node_id root { arena.append(fs::no_node, "/data", fs::file_type::directory) };
+    const fs::node_id b { arena.append(root, "b", fs::file_type::directory) }; // note: unsorted, sorted when written
+    const fs::node_id a { arena.append(root, "a", fs::file_type::directory) };
+    const fs::node_id y_node { arena.append(a, "y", fs::file_type::file) };
+    arena.length(arena.append(a, "x", fs::file_type::file)) = x;
+    arena.length(y_node) = y;
+    arena.length(arena.append(b, "z", fs::file_type::file)) = z;
+    arena.set_children(root, b, 2);
+    arena.set_children(a, y_node, 2);
+    arena.set_children(b, y_node + 2, 1);
+    arena.length(a) = x + y;
+    arena.length(b) = z;
+    arena.length(root) = x + y + z;
+    return root;
+}
+
+void test_snapshot_round_trip() {
+    const std::string path { create_snapshot_path() };
+    fs::node_tree tree;
+    fs::snapshot::write(path, tree, {create_snapshot_tree(tree, 1, 2, 3)});
+
+    const fs::snapshot snapshot(path);
+    unit::assert_equals(6ul, snapshot.size(), "number of nodes");
+    unit::assert_equals(1ul, snapshot.root_count(), "number of roots");
+    unit::assert_equals(6ul, snapshot.length(0), "length of root");
+    unit::assert_equals(2u, snapshot.child_count(0), "number of children");
+    unit::assert_equals("a", std::string(snapshot.name(snapshot.first_child(0))), "children sorted by name");
+
+    const unsigned long y { snapshot.find("/data/a/y") };
+    unit::assert_true(y != fs::snapshot::no_node, "file found by path");
+    unit::assert_equals(2ul, snapshot.length(y), "length of file");
+    unit::assert_equals("/data/a/y", snapshot.path(y), "path of file");
+    unit::assert_true(snapshot.find("/data/a/w") == fs::snapshot::no_node, "missing file not found");
+    unit::assert_true(snapshot.find("/dat") == fs::snapshot::no_node, "prefix of root not found");
+    unit::assert_equals(0ul, snapshot.find("/data/"), "root found with trailing slash");
+
+    const fs::file_info_t fi { snapshot.to_file_info(snapshot.find("/data/b/z")) };
+    unit::assert_equals("/data/b", fi.path, "path of file info");
+    unit::assert_equals("z", fi.name, "name of file info");
+    unit::assert_equals(3ul, fi.length, "length of file info");
+    unlink(path.c_str());
+}
+
+void test_snapshot_invalid_file() {
+    const std::string path { create_snapshot_path() };
+    std::ofstream(path) << "not a snapshot";
+    bool thrown {false};
+    try {
+        fs::snapshot snapshot(path);
+    }
+    catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    unit::assert_true(thrown, "invalid snapshot rejected");
+    unlink(path.c_str());
+}
+
+void test_snapshot_diff() {
+    const std::string older_path { create_snapshot_path() };
+    const std::string newer_path { create_snapshot_path() };
+    {
+        fs::node_tree tree;
+        fs::snapshot::write(older_path, tree, {create_snapshot_tree(tree, 1, 2, 3)});
+    }
+    {
+        // "a" grown, "b" removed, "c" created
+        fs::node_tree tree;
+        fs::node_arena &arena = tree.local_arena();
+        const fs::node_id root { arena.append(fs::no_node, "/data", fs::file_type::directory) };
+        const fs::node_id a { arena.append(root, "a", fs::file_type::directory) };
+        arena.length(arena.append(root, "c", fs::file_type::file)) = 7;
+        arena.length(a) = 10;
+        arena.set_children(root, a, 2);
+        fs::snapshot::write(newer_path, tree, {root});
+    }
+
+    const fs::snapshot older(older_path);
+    const fs::snapshot newer(newer_path);
+    const std::vector<fs::snapshot_change_t> changes { fs::diff_snapshots(older, 0, newer, 0) };
+    unit::assert_equals(3u, changes.size(), "number of changes");
+    unit::assert_equals("a", changes[0].file.name, "name of grown entry");
+    unit::assert_equals(7l, changes[0].delta, "delta of grown entry");
+    unit::assert_equals("b", changes[1].file.name, "name of removed entry");
+    unit::assert_equals(-3l, changes[1].delta, "delta of removed entry");
+    unit::assert_equals("c", changes[2].file.name, "name of created entry");
+    unit::assert_equals(7l, changes[2].delta, "delta of created entry");
+
+    const std::vector<fs::snapshot_change_t> sub_changes { fs::diff_snapshots(older, older.find("/data/b"), newer, newer.find("/data/b")) };
+    unit::assert_equals(1u, sub_changes.size(), "number of changes within removed directory");
+    unit::assert_equals(-3l, sub_changes[0].delta, "delta within removed directory");
+    unit::assert_equals(0u, fs::diff_snapshots(older, 0, older, 0).size(), "no changes to itself");
+    unlink(older_path.c_str());
+    unlink(newer_path.c_str());
+}
+
+void performance_snapshot() {
+    std::cout << "performance snapshot" << std::endl;
+    const unsigned int directory_count {1000};
+    const unsigned int file_count {1000}; // per directory
+    const std::string older_path { create_snapshot_path() };
+    const std::string newer_path { create_snapshot_path() };
+
+    const auto write_start = std::chrono::high_resolution_clock::now();
+    for (const auto &path: {older_path, newer_path}) {
+        fs::node_tree tree;
+        fs::node_arena &arena = tree.local_arena();
+        const fs::node_id root { arena.append(fs::no_node, "/data", fs::file_type::directory) };
+        std::vector<fs::node_id> directories {};
+        for (unsigned int i = 0; i < directory_count; i++)
+            directories.push_back(arena.append(root, "directory_" + std::to_string(i), fs::file_type::directory));
+        arena.set_children(root, directories.front(), directory_count);
+        for (unsigned int i = 0; i < directory_count; i++) {
+            const fs::node_id first { arena.node(arena.size()) };
+            for (unsigned int j = 0; j < file_count; j++)
+                arena.length(arena.append(directories[i], "file_" + std::to_string(j), fs::file_type::file)) = (path == newer_path && i % 10 == 0) ? j + 1 : j;
+            arena.set_children(directories[i], first, file_count);
+            arena.length(directories[i]) = arena.sum_lengths(first, file_count);
+        }
+        arena.length(root) = arena.sum_lengths(directories.front(), directory_count);
+        fs::snapshot::write(path, tree, {root});
+    }
+    std::chrono::duration<double, std::milli> write_time = std::chrono::high_resolution_clock::now() - write_start;
+
+    const auto diff_start = std::chrono::high_resolution_clock::now();
+    {
+        const fs::snapshot older(older_path);
+        const fs::snapshot newer(newer_path);
+        unit::assert_equals(directory_count / 10u, fs::diff_snapshots(older, 0, newer, 0).size(), "changed directories");
+        const std::string path { "/data/directory_10" };
+        unit::assert_equals(file_count, fs::diff_snapshots(older, older.find(path), newer, newer.find(path)).size(), "changed files");
+    }
+    std::chrono::duration<double, std::milli> diff_time = std::chrono::high_resolution_clock::now() - diff_start;
+
+    std::cout << " - build and write: " << write_time.count() / 2 << "ms - load and diff: " << diff_time.count() << "ms (" << directory_count * file_count << " nodes per snapshot)" << std::endl;
+    unlink(older_path.c_str());
+    unlink(newer_path.c_str());
+}
+
+unit::test_suite get_suite_snapshot() {
+    unit::test_suite suite("snapshot.hpp");
+    suite.add_test(test_snapshot_round_trip, "write() and read back of node tree");
+    suite.add_test(test_snapshot_invalid_file, "invalid snapshot file");
+    suite.add_test(test_snapshot_diff, "diff_snapshots() of directory level");
+
+    suite.add_test(performance_snapshot, "");
+    return suite;
+}
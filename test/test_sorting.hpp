@@ -0,0 +1,70 @@
+#include "unit.hpp"
+#include "sorting.hpp"
+#include "fs.hpp"
+
+#include <chrono>
+#include <functional>
+#include <random>
+
+std::vector<fs::file_info_t> create_sort_files(const std::size_t file_count) {
+    std::mt19937 generator(42);
+    std::vector<fs::file_info_t> files(file_count);
+    for (auto &file: files) {
+        file.length = generator() % (file_count * 4);
+        file.name = "file_" + std::to_string(generator());
+    }
+    return files;
+}
+
+void test_sort_head() {
+    const std::function<bool (const fs::file_info_t &, const fs::file_info_t &)> compare = [] (const fs::file_info_t &a, const fs::file_info_t &b) { return a.length > b.length; };
+    std::vector<fs::file_info_t> sorted { create_sort_files(10000) };
+    std::sort(sorted.begin(), sorted.end(), compare);
+
+    // Heap selection, nth_element selection and full sort
+    for (const std::size_t count: {0ul, 1ul, 20ul, 100ul, 5000ul, 9999ul, 10000ul, 20000ul}) {
+        std::vector<fs::file_info_t> files { create_sort_files(10000) };
+        sorting::sort_head(files.begin(), files.end(), count, compare);
+        unit::assert_equals(10000u, files.size(), "no elements lost, count " + std::to_string(count));
+        for (std::size_t i = 0; i < std::min(count, files.size()); i++) {
+            if (files[i].length != sorted[i].length) {
+                unit::assert_equals(sorted[i].length, files[i].length, "head sorted, count " + std::to_string(count) + ", index " + std::to_string(i));
+                break;
+            }
+        }
+    }
+}
+
+void performance_sort_head() {
+    std::cout << "performance sort head (crossover: std::partial_sort up to 1/" << sorting::partial_sort_ratio << " of the files)" << std::endl;
+    const std::size_t file_count {100000};
+    const std::vector<fs::file_info_t> files { create_sort_files(file_count) };
+    const std::function<bool (const fs::file_info_t &, const fs::file_info_t &)> compare = [] (const fs::file_info_t &a, const fs::file_info_t &b) { return a.length > b.length; };
+
+    const auto measure = [&files] (const std::function<void (std::vector<fs::file_info_t> &)> &sort) {
+        std::vector<fs::file_info_t> temp { files };
+        const auto start = std::chrono::high_resolution_clock::now();
+        sort(temp);
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    const double sort_time { measure([&compare] (std::vector<fs::file_info_t> &temp) { std::sort(temp.begin(), temp.end(), compare); }) };
+    std::cout << " - std::sort: " << sort_time << "ms (" << file_count << " files)" << std::endl;
+    for (const std::size_t count: {10ul, 100ul, 500ul, 1000ul, 2000ul, 5000ul, 20000ul, 50000ul}) {
+        const double partial_time { measure([&compare, count] (std::vector<fs::file_info_t> &temp) { std::partial_sort(temp.begin(), temp.begin() + count, temp.end(), compare); }) };
+        const double nth_time { measure([&compare, count] (std::vector<fs::file_info_t> &temp) {
+            std::nth_element(temp.begin(), temp.begin() + count, temp.end(), compare);
+            std::sort(temp.begin(), temp.begin() + count, compare);
+        }) };
+        const double head_time { measure([&compare, count] (std::vector<fs::file_info_t> &temp) { sorting::sort_head(temp.begin(), temp.end(), count, compare); }) };
+        std::cout << " - count " << count << ": std::partial_sort: " << partial_time << "ms - std::nth_element: " << nth_time << "ms - sort_head: " << head_time << "ms" << std::endl;
+    }
+}
+
+unit::test_suite get_suite_sorting() {
+    unit::test_suite suite("sorting.hpp");
+    suite.add_test(test_sort_head, "sort_head() equals head of full sort");
+
+    suite.add_test(performance_sort_head, "");
+    return suite;
+}
@@ -30,6 +30,16 @@ void test_thread_throws_exception() {
     unit::assert_equals(threading::task_status::failed, task->status, "status of finished task");
 }
 
+void test_spawn_throws_exception() {
+    threading::thread_pool tp(2);
+    bool joined {false};
+    threading::task_group group([&joined] { joined = true; });
+    tp.spawn([] { throw std::runtime_error("exception within spawned task"); }, &group);
+    tp.close_group(group);
+    tp.wait();
+    unit::assert_true(joined, "continuation after the task threw");
+}
+
 void test_dtor_abort_tasks_in_queue() {
     const auto start_time = std::chrono::high_resolution_clock::now();
     {
@@ -48,6 +58,123 @@ void test_dtor_abort_tasks_in_queue() {
     unit::assert_true(elapsed_time.count() < 500.0, "d'tor took at most 500ms: " + std::to_string(elapsed_time.count()) + "ms");
 }
 
+void test_abort_tasks() {
+    threading::thread_pool tp(1);
+    std::atomic_uint counter {0};
+    std::vector<std::shared_ptr<threading::task_t>> tasks {};
+    for (unsigned int i = 0; i < 10; i++) {
+        tasks.push_back(tp.add([&counter, &tp](const std::function<bool (const std::shared_ptr<threading::task_t> &)> &) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            counter++;
+            tp.abort_tasks(); // note: the running task is completed
+        }));
+    }
+    tp.wait();
+    unit::assert_true(tp.is_aborted(), "pool aborted");
+    unit::assert_equals(1u, counter.load(), "tasks executed");
+    unit::assert_equals(threading::task_status::done, tasks.front()->status, "status of running task");
+    unit::assert_equals(threading::task_status::aborted, tasks.back()->status, "status of pending task");
+    const std::shared_ptr<threading::task_t> added { tp.add([](const std::function<bool (const std::shared_ptr<threading::task_t> &)> &) {}) };
+    tp.wait();
+    unit::assert_equals(threading::task_status::aborted, added->status, "status of task added after abort");
+}
+
+// Node of a tree summed by continuations, each level completes its parent's group
+struct group_node_t {
+    unsigned long sum {0};
+    unsigned long *parent_sum {nullptr};
+    std::unique_ptr<threading::task_group> group {};
+};
+
+void test_task_group() {
+    threading::thread_pool tp(3);
+    std::atomic_uint continuations {0};
+
+    // Binary tree of depth 10, each leaf counts 1
+    std::function<void (unsigned int, unsigned long &, threading::task_group *)> spawn = [&] (unsigned int depth, unsigned long &result, threading::task_group *parent) {
+        if (depth == 0) {
+            result = 1;
+            return;
+        }
+        std::shared_ptr<group_node_t> node { std::make_shared<group_node_t>() };
+        std::shared_ptr<unsigned long[]> sums(new unsigned long[2]{0, 0});
+        node->group = std::make_unique<threading::task_group>([&continuations, &result, node, sums] {
+            result = sums[0] + sums[1];
+            continuations++;
+        }, parent);
+        for (unsigned int i = 0; i < 2; i++) {
+            tp.add([&spawn, depth, sums, i, node] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &) {
+                spawn(depth - 1, sums[i], node->group.get());
+            }, node->group.get());
+        }
+        tp.close_group(*node->group);
+    };
+    unsigned long total {0};
+    tp.add([&spawn, &total] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &) { spawn(10, total, nullptr); });
+    tp.wait();
+    unit::assert_equals(1024ul, total, "leaves summed by continuations");
+    unit::assert_equals(1023u, continuations.load(), "continuations executed");
+
+    // Continuation of a group without tasks runs on close
+    bool closed {false};
+    threading::task_group empty([&closed] { closed = true; });
+    tp.close_group(empty);
+    unit::assert_true(closed, "continuation of empty group");
+}
+
+void test_spawn_range() {
+    threading::thread_pool tp(3);
+    std::atomic_uint counter {0};
+    std::vector<unsigned int> values(100, 0);
+    std::vector<std::function<void ()>> tasks {};
+    for (unsigned int i = 0; i < values.size(); i++)
+        tasks.push_back([&counter, &values, i] { values[i] = i; counter++; });
+
+    unsigned int joined {0};
+    threading::task_group group([&joined, &counter] { joined = counter.load(); });
+    tp.spawn(tasks.begin(), tasks.end(), &group);
+    tp.spawn(tasks.end(), tasks.end(), &group); // note: empty range
+    tp.close_group(group);
+    tp.wait();
+    unit::assert_equals(100u, counter.load(), "tasks executed");
+    unit::assert_equals(100u, joined, "continuation after all tasks of the range");
+    unit::assert_equals(99u, values.back(), "task of the range executed");
+}
+
+void test_spawn_worker_local() {
+    // Tasks spawned by a worker are run depth-first (LIFO) by that worker
+    threading::thread_pool tp(1);
+    std::vector<unsigned int> order {};
+    tp.spawn([&tp, &order] {
+        std::vector<std::function<void ()>> tasks {};
+        for (unsigned int i = 0; i < 3; i++) {
+            tasks.push_back([&tp, &order, i] {
+                order.push_back(i);
+                if (i == 0)
+                    tp.spawn([&order] { order.push_back(3); });
+            });
+        }
+        tp.spawn(tasks.begin(), tasks.end());
+    });
+    tp.wait();
+    unit::assert_equals(std::string("2103"), std::to_string(order[0]) + std::to_string(order[1]) + std::to_string(order[2]) + std::to_string(order[3]), "order of spawned tasks");
+}
+
+void test_task_group_deep_nesting() {
+    // A chain of nested groups completes iteratively, the stack does not grow with its depth
+    const unsigned int depth {100000};
+    std::vector<std::unique_ptr<threading::task_group>> groups {};
+    std::atomic_uint continuations {0};
+    threading::thread_pool tp(2);
+    for (unsigned int i = 0; i < depth; i++)
+        groups.push_back(std::make_unique<threading::task_group>([&continuations] { continuations++; }, groups.empty() ? nullptr : groups.back().get()));
+    tp.add([] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &) {}, groups.back().get());
+    for (auto group = groups.begin(); group != groups.end(); group++)
+        tp.close_group(**group); // note: the innermost group completes with the task
+    tp.wait();
+    unit::assert_equals(depth, continuations.load(), "continuations of the nested groups");
+}
+
 unsigned int performance_execute(const std::function<void (void)> task, const unsigned int iterations = 100) {
     std::cout << "  current thread (sync)" << std::endl;
     const auto start_time_sync = std::chrono::high_resolution_clock::now();
@@ -101,15 +228,96 @@ void performance_y() {
     performance_execute(task, 1000);
 }
 
+void performance_spawn_join() {
+    std::cout << "performance spawn and join (binary tree of tasks, joined by task groups)" << std::endl;
+    const unsigned int depth {17};
+    for (const unsigned int thread_count: {1u, 4u}) {
+        threading::thread_pool tp(thread_count);
+        std::atomic_ulong leaves {0};
+
+        // Handle per task (shared_ptr and std::function) versus recycled slots
+        std::function<void (unsigned int, threading::task_group *)> add_tree = [&] (unsigned int level, threading::task_group *group) {
+            if (level == 0) {
+                leaves++;
+                return;
+            }
+            for (unsigned int i = 0; i < 2; i++)
+                tp.add([&add_tree, level, group] (const std::function<bool (const std::shared_ptr<threading::task_t> &)> &) { add_tree(level - 1, group); }, group);
+        };
+        std::function<void (unsigned int, threading::task_group *)> spawn_tree = [&] (unsigned int level, threading::task_group *group) {
+            if (level == 0) {
+                leaves++;
+                return;
+            }
+            for (unsigned int i = 0; i < 2; i++)
+                tp.spawn([&spawn_tree, level, group] { spawn_tree(level - 1, group); }, group);
+        };
+
+        const auto measure = [&tp] (const std::function<void (unsigned int, threading::task_group *)> &tree) {
+            bool joined {false};
+            threading::task_group group([&joined] { joined = true; });
+            const auto start = std::chrono::high_resolution_clock::now();
+            tree(depth, &group);
+            tp.close_group(group);
+            tp.wait();
+            const std::chrono::duration<double, std::milli> elapsed { std::chrono::high_resolution_clock::now() - start };
+            unit::assert_true(joined, "continuation of the joined group");
+            return elapsed.count();
+        };
+        measure(spawn_tree); // note: fills the freelists
+        const double add_time { measure(add_tree) };
+        const double spawn_time { measure(spawn_tree) };
+        unit::assert_equals(3ul << depth, leaves.load(), "leaves of all trees");
+        const unsigned long task_count { (2ul << depth) - 2 };
+        std::cout << " - thread_pool(" << thread_count << "): add(): " << add_time << "ms - spawn(): " << spawn_time << "ms (" << task_count << " tasks)" << std::endl;
+    }
+}
+
+void performance_spawn_narrow() {
+    std::cout << "performance spawn narrow tree (chain of tasks, each spawning a leaf and its successor)" << std::endl;
+    const unsigned int depth {20000};
+    for (const unsigned int thread_count: {1u, 4u}) {
+        threading::thread_pool tp(thread_count);
+        std::atomic_uint leaves {0};
+
+        // Only the worker running the chain pushes, the leaves are left to idle workers
+        std::function<void (unsigned int, threading::task_group *)> chain = [&] (unsigned int level, threading::task_group *group) {
+            if (level == 0)
+                return;
+            tp.spawn([&leaves] { for (unsigned int i = 0; i < 20000; i++); leaves++; }, group);
+            tp.spawn([&chain, level, group] { chain(level - 1, group); }, group);
+        };
+
+        bool joined {false};
+        threading::task_group group([&joined] { joined = true; });
+        const auto start = std::chrono::high_resolution_clock::now();
+        tp.spawn([&chain, &group] { chain(depth, &group); }, &group);
+        tp.close_group(group);
+        tp.wait();
+        const std::chrono::duration<double, std::milli> elapsed { std::chrono::high_resolution_clock::now() - start };
+        unit::assert_true(joined, "continuation of the joined group");
+        unit::assert_equals(depth, leaves.load(), "leaves of the chain");
+        std::cout << " - thread_pool(" << thread_count << "): " << elapsed.count() << "ms (" << 2 * depth + 1 << " tasks)" << std::endl;
+    }
+}
+
 unit::test_suite get_suite_thread_pool() {
     unit::test_suite suite("thread_pool.hpp");
     suite.add_test(test_ctor_invalid_thread_count, "c'tor with invalid thread count");
     suite.add_test(test_threads_join, "add more tasks than threads and wait for all jobs to complete");
     suite.add_test(test_thread_throws_exception, "handling of task which throws an unhandled exception");
+    suite.add_test(test_spawn_throws_exception, "spawned task which throws completes its part of the group");
     suite.add_test(test_dtor_abort_tasks_in_queue, "d'tor should abort all queued tasks and wait for all jobs to complete");
+    suite.add_test(test_abort_tasks, "abort_tasks() completes running task and aborts pending ones");
+    suite.add_test(test_task_group, "continuations of task groups run once their tasks and nested groups completed");
+    suite.add_test(test_spawn_range, "spawn() of a range of tasks joined by a task group");
+    suite.add_test(test_spawn_worker_local, "spawn() within a worker pushes to its own deque (LIFO)");
+    suite.add_test(test_task_group_deep_nesting, "deeply nested task groups complete without recursion");
 
     suite.add_test(performance_x, "");
     suite.add_test(performance_y, "");
+    suite.add_test(performance_spawn_join, "");
+    suite.add_test(performance_spawn_narrow, "");
     return suite;
 }
 
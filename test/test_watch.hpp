@@ -0,0 +1,113 @@
+#include "unit.hpp"
+#include "watch.hpp"
+
+// Scans the directory serially into the tree, returns the node of the directory
+fs::node_id scan_node_tree(fs::node_tree &tree, const std::string &path) {
+    const unsigned int fields { fs::file_field::field_type | fs::file_field::field_length };
+    std::shared_ptr<fs::directory> dir = fs::open_directory(path);
+    const fs::node_id root { tree.local_arena().append(fs::no_node, path, fs::file_type::directory) };
+    fs::file_error error {fs::file_error::none};
+    const unsigned long contents_length { fs::scan_subtree(tree, root, *dir, fields, nullptr, nullptr, error, [] (const fs::directory &, const fs::node_id) {}) };
+    tree.arena(root).length(root) = fs::read_file(path, fields).length + contents_length;
+    return root;
+}
+
+unsigned long watched_length(const fs::node_tree &tree, const watch::tree_watcher &watcher, const fs::node_id node, const std::string &name) {
+    for (const fs::node_id child: watcher.children(node)) {
+        if (name == tree.arena(child).name(child))
+            return tree.arena(child).length(child);
+    }
+    return 0;
+}
+
+// Applies the pending events, which are delivered asynchronously
+void wait_for_changes(watch::tree_watcher &watcher) {
+    for (int i = 0; i < 10 && watcher.update(100); i++);
+}
+
+void test_watch_backend(const watch::backend backend) {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("cd " + path + " && mkdir -p a/b c && printf 12345 > a/b/file && printf 678 > c/file");
+
+    fs::node_tree tree;
+    const fs::node_id root { scan_node_tree(tree, path) };
+    std::unique_ptr<watch::tree_watcher> watcher {nullptr};
+    try {
+        watcher = std::make_unique<watch::tree_watcher>(tree, root, fs::file_field::field_type | fs::file_field::field_length, nullptr, backend);
+    }
+    catch (const std::runtime_error &) {
+        return; // Backend not available
+    }
+    if (backend == watch::backend::fanotify && watcher->unwatched_directories() > 0)
+        return; // Marking the file system not permitted, e.g. without CAP_SYS_ADMIN
+    unit::assert_equals(0ul, watcher->unwatched_directories(), "all directories watched");
+    const unsigned long directory_length { fs::read_file(path + "/c", fs::file_field::field_length).length };
+    const unsigned long a_length { watched_length(tree, *watcher, root, "a") };
+    unit::assert_equals(2 * directory_length + 5, a_length, "scanned length");
+
+    // Content change below a subdirectory
+    exec("printf 1234567890 > " + path + "/a/b/file");
+    wait_for_changes(*watcher);
+    unit::assert_equals(a_length + 5, watched_length(tree, *watcher, root, "a"), "length after modification");
+
+    // Entries created and removed
+    exec("rm " + path + "/c/file && mkdir " + path + "/d && printf 12 > " + path + "/d/file");
+    wait_for_changes(*watcher);
+    unit::assert_equals(directory_length, watched_length(tree, *watcher, root, "c"), "length after removal");
+    unit::assert_equals(directory_length + 2, watched_length(tree, *watcher, root, "d"), "length of created directory");
+    unit::assert_equals(3u, watcher->children(root).size(), "number of entries after creation");
+
+    // Directory moved within the tree
+    exec("mv " + path + "/d " + path + "/a/b/");
+    wait_for_changes(*watcher);
+    unit::assert_equals(2u, watcher->children(root).size(), "number of entries after move");
+    unit::assert_equals(a_length + 5 + directory_length + 2, watched_length(tree, *watcher, root, "a"), "length after move");
+    const unsigned long root_length { fs::read_file(path, fs::file_field::field_length).length };
+    unit::assert_equals(root_length + a_length + 5 + directory_length + 2 + directory_length, tree.arena(root).length(root), "length of root");
+}
+
+void test_watch_fanotify() {
+    test_watch_backend(watch::backend::fanotify);
+}
+
+void test_watch_inotify() {
+    test_watch_backend(watch::backend::inotify);
+}
+
+void test_watch_automatic() {
+    test_watch_backend(watch::backend::automatic);
+}
+
+void test_watch_rescan() {
+    const test_directory temp {};
+    const std::string &path = temp.path;
+    exec("cd " + path + " && mkdir -p a/b c && printf 12345 > a/b/file && printf 678 > c/file");
+
+    fs::node_tree tree;
+    const fs::node_id root { scan_node_tree(tree, path) };
+    watch::tree_watcher watcher(tree, root, fs::file_field::field_type | fs::file_field::field_length, nullptr, watch::backend::inotify);
+    const std::size_t node_count { tree.size() };
+    const unsigned long directory_length { fs::read_file(path + "/c", fs::file_field::field_length).length };
+    const unsigned long a_length { watched_length(tree, watcher, root, "a") };
+
+    // Lost events, e.g. on queue overflow: kept entries are refreshed in place
+    exec("printf 1234567890 > " + path + "/a/b/file && rm " + path + "/c/file && printf 12 > " + path + "/e");
+    for (unsigned int i = 0; i < 3; i++)
+        watcher.rescan();
+    unit::assert_equals(node_count + 1, tree.size(), "only the created entry appended");
+    unit::assert_equals(a_length + 5, watched_length(tree, watcher, root, "a"), "length after modification");
+    unit::assert_equals(directory_length, watched_length(tree, watcher, root, "c"), "length after removal");
+    unit::assert_equals(3u, watcher.children(root).size(), "number of entries");
+    const unsigned long root_length { fs::read_file(path, fs::file_field::field_length).length };
+    unit::assert_equals(root_length + a_length + 5 + directory_length + 2, tree.arena(root).length(root), "length of root");
+}
+
+unit::test_suite get_suite_watch() {
+    unit::test_suite suite("watch.hpp");
+    suite.add_test(test_watch_fanotify, "tree_watcher with fanotify (skipped if not permitted)");
+    suite.add_test(test_watch_inotify, "tree_watcher with inotify");
+    suite.add_test(test_watch_automatic, "tree_watcher falls back to inotify if fanotify is not permitted");
+    suite.add_test(test_watch_rescan, "rescan() after lost events refreshes the tree in place");
+    return suite;
+}
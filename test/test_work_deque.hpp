@@ -0,0 +1,64 @@
+#include "unit.hpp"
+#include "work_deque.hpp"
+
+#include <thread>
+#include <atomic>
+
+void test_work_deque_order() {
+    threading::work_deque<unsigned int> deque(2);
+    std::vector<unsigned int> values { 1, 2, 3, 4, 5 };
+    for (auto &value: values)
+        deque.push(&value); // note: grows twice
+    unit::assert_equals(5l, deque.size(), "size of deque");
+    unit::assert_equals(1u, *deque.steal(), "steal from top (FIFO)");
+    unit::assert_equals(5u, *deque.pop(), "pop from bottom (LIFO)");
+    unit::assert_equals(4u, *deque.pop(), "pop from bottom (LIFO)");
+    unit::assert_equals(2u, *deque.steal(), "steal from top (FIFO)");
+    unit::assert_equals(3u, *deque.pop(), "pop last item");
+    unit::assert_true(deque.pop() == nullptr, "pop from empty deque");
+    unit::assert_true(deque.steal() == nullptr, "steal from empty deque");
+}
+
+void test_work_deque_concurrent_steal() {
+    const unsigned int thief_count {4};
+    const unsigned int value_count {100000};
+    threading::work_deque<unsigned int> deque(16);
+    std::vector<unsigned int> values(value_count);
+    std::vector<std::atomic_uint> taken(value_count);
+    std::atomic_bool done {false};
+
+    // Every value must be taken exactly once, either by the owner or by one of the thieves
+    std::vector<std::thread> thieves;
+    for (unsigned int t = 0; t < thief_count; t++) {
+        thieves.emplace_back([&deque, &values, &taken, &done] () {
+            while (!done.load() || !deque.empty()) {
+                unsigned int *value { deque.steal() };
+                if (value != nullptr)
+                    taken[value - values.data()]++;
+            }
+        });
+    }
+    for (unsigned int i = 0; i < value_count; i++) {
+        deque.push(&values[i]);
+        if (i % 3 == 0) {
+            unsigned int *value { deque.pop() };
+            if (value != nullptr)
+                taken[value - values.data()]++;
+        }
+    }
+    done.store(true);
+    for (auto &thief: thieves)
+        thief.join();
+
+    unsigned int taken_once {0};
+    for (const auto &count: taken)
+        taken_once += count.load() == 1 ? 1 : 0;
+    unit::assert_equals(value_count, taken_once, "number of values taken exactly once");
+}
+
+unit::test_suite get_suite_work_deque() {
+    unit::test_suite suite("work_deque.hpp");
+    suite.add_test(test_work_deque_order, "push(), pop() and steal() order");
+    suite.add_test(test_work_deque_concurrent_steal, "concurrent steal() while owner pushes and pops");
+    return suite;
+}